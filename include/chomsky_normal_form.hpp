@@ -1,15 +1,51 @@
-
+#pragma once
 #include <climits>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <stdexcept>
 #include <string>
 #include <unordered_set>
 #include "cnf_grammar.hpp"
 
+struct vector_hash {
+    template<typename T>
+    std::size_t operator()(const std::vector<T>& v) const noexcept {
+        std::size_t h = v.size();
+        for (const auto& x : v) {
+            h ^= std::hash<T>{}(x) + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+        }
+        return h;
+    }
+};
+
 // The orderings START,TERM,BIN,DEL,UNIT and START,BIN,DEL,UNIT,TERM lead to the least (i.e. quadratic) blow-up.
+//
+// Weighted grammars keep their rule probabilities in step with the productions. Every
+// step preserves the inside probability of each word: new helper rules get weight 1,
+// DEL multiplies a rule by the ε-probability of every symbol it drops, UNIT folds unit
+// chains in through (I - M)^-1 over the unit rule weights, and rules that become equal
+// have their weights added up.
 
 class ChomskyNormalForm {
 public:
+    // bumped whenever normalize() gives a different result for the same grammar, so
+    // stored results (GrammarCache) of older versions are not used any more
+    static constexpr uint32_t VERSION = 1;
+
     explicit ChomskyNormalForm(Grammar g)
-        : grammar_{std::move(g)} {};
+        : grammar_{std::move(g)},
+          weighted_{grammar_.is_weighted()} {
+        if (weighted_) {
+            for (const auto& [lhs, rhses] : grammar_.productions) {
+                auto it = grammar_.weights.find(lhs);
+                if (it == grammar_.weights.end() || it->second.size() != rhses.size()) {
+                    throw std::runtime_error("Weights of " + lhs + " do not match its productions");
+                }
+            }
+        }
+    };
 
     void normalize() {
         START();
@@ -17,10 +53,13 @@ public:
         BIN();
         DEL();
         dedup_productions();
+        // a useless A -> A would otherwise look like a unit cycle of probability 1
+        eliminate_non_productive_sym();
         UNIT();
         dedup_productions();
-        eliminate_inaccesible_sym();
         eliminate_non_productive_sym();
+        eliminate_inaccesible_sym();
+        merge_equivalent_non_terminals();
     }
 
     Grammar result() const { return grammar_; }
@@ -28,8 +67,12 @@ public:
 private:
     void dedup_productions();
 
+    template<typename Pred>
+    void erase_productions_if(const Grammar::LHS& lhs, std::vector<Grammar::RHS>& rhses, Pred pred);
+
     void eliminate_inaccesible_sym();
     void eliminate_non_productive_sym();
+    void merge_equivalent_non_terminals();
 
     std::string fresh_non_terminal(const std::string& pref);
 
@@ -40,6 +83,7 @@ private:
     void UNIT();
 
     Grammar grammar_;
+    bool weighted_;
 };
 
 inline std::string ChomskyNormalForm::fresh_non_terminal(const std::string& prefix) {
@@ -85,6 +129,9 @@ inline void ChomskyNormalForm::eliminate_inaccesible_sym() {
     std::erase_if(grammar_.productions, [&](const auto& p) {
         return !visited.contains(p.first);
     });
+    std::erase_if(grammar_.weights, [&](const auto& w) {
+        return !visited.contains(w.first);
+    });
 
     grammar_.non_terminals = std::move(visited);
 }
@@ -131,9 +178,12 @@ inline void ChomskyNormalForm::eliminate_non_productive_sym() {
     std::erase_if(grammar_.productions, [&](const auto& p) {
         return !productive.contains(p.first);
     });
+    std::erase_if(grammar_.weights, [&](const auto& w) {
+        return !productive.contains(w.first);
+    });
 
     for (auto& [lhs, rhses] : grammar_.productions) {
-        std::erase_if(rhses, [&](const auto& rhs) {
+        erase_productions_if(lhs, rhses, [&](const auto& rhs) {
             return std::ranges::any_of(rhs, [&](const auto& sym) {
                 return grammar_.non_terminals.contains(sym) && !productive.contains(sym);
             });
@@ -141,20 +191,195 @@ inline void ChomskyNormalForm::eliminate_non_productive_sym() {
     }
 
     grammar_.non_terminals = std::move(productive);
+
+    // an empty language still needs a start symbol, it just has no productions
+    grammar_.non_terminals.insert(grammar_.start_symbol);
+}
+
+// BIN and TERM leave structurally identical non-terminals behind (A* chains ending the
+// same way, S and its copy after UNIT, ...). Non-terminals are split into classes the
+// way DFA states are minimized: start with everything in one class, then keep splitting
+// by the set of (hash-consed) right hand sides written in terms of the current classes
+// until nothing splits anymore. Each class is then replaced by its smallest member.
+// For weighted grammars a right hand side only matches together with its total weight.
+inline void ChomskyNormalForm::merge_equivalent_non_terminals() {
+    std::vector<Grammar::Symbol> names(grammar_.non_terminals.begin(), grammar_.non_terminals.end());
+    std::unordered_map<Grammar::Symbol, int> id;
+    for (size_t i = 0; i < names.size(); ++i) {
+        id[names[i]] = i;
+    }
+
+    std::unordered_map<Grammar::Symbol, int> terminal_id;
+
+    // the start symbol stays alone so it never ends up on a right hand side
+    std::vector<int> cls(names.size(), 1);
+    cls[id.at(grammar_.start_symbol)] = 0;
+    size_t class_count = 0;
+
+    while (true) {
+        std::unordered_map<std::vector<int>, int, vector_hash> rhs_ids;
+        std::map<std::pair<int, double>, int> weighted_ids;
+        std::unordered_map<std::vector<int>, int, vector_hash> signatures;
+        std::vector<int> next(names.size());
+
+        for (size_t i = 0; i < names.size(); ++i) {
+            std::vector<int> signature = { cls[i] };
+            std::vector<std::pair<int, double>> rules;
+
+            auto it = grammar_.productions.find(names[i]);
+            if (it != grammar_.productions.end()) {
+                for (size_t j = 0; j < it->second.size(); ++j) {
+                    const auto& rhs = it->second[j];
+                    // non-terminals by class, terminals as negative ids
+                    std::vector<int> key;
+                    key.reserve(rhs.size());
+                    for (const auto& sym : rhs) {
+                        auto nt = id.find(sym);
+                        key.push_back(nt != id.end()
+                            ? cls[nt->second]
+                            : -1 - terminal_id.try_emplace(sym, terminal_id.size()).first->second);
+                    }
+
+                    const int rhs_id = rhs_ids.try_emplace(std::move(key), rhs_ids.size()).first->second;
+                    rules.push_back({ rhs_id, weighted_ ? grammar_.weights.at(names[i])[j] : 0.0 });
+                }
+            }
+
+            std::ranges::sort(rules);
+            for (size_t j = 0; j < rules.size(); ++j) {
+                if (!weighted_) {
+                    signature.push_back(rules[j].first);
+                    continue;
+                }
+
+                // rules that are equal up to classes merge later, so they count with their summed weight
+                double weight = rules[j].second;
+                while (j + 1 < rules.size() && rules[j + 1].first == rules[j].first) {
+                    weight += rules[++j].second;
+                }
+                signature.push_back(weighted_ids.try_emplace({ rules[j].first, weight }, weighted_ids.size()).first->second);
+            }
+
+            std::sort(signature.begin() + 1, signature.end());
+            signature.erase(std::unique(signature.begin() + 1, signature.end()), signature.end());
+            next[i] = signatures.try_emplace(std::move(signature), signatures.size()).first->second;
+        }
+
+        cls = std::move(next);
+        if (signatures.size() == class_count) break;
+        class_count = signatures.size();
+    }
+
+    if (class_count == names.size()) {
+        return;
+    }
+
+    // names are sorted, so the first member seen is the smallest one
+    std::unordered_map<int, Grammar::Symbol> representative;
+    for (size_t i = 0; i < names.size(); ++i) {
+        representative.try_emplace(cls[i], names[i]);
+    }
+    representative[cls[id.at(grammar_.start_symbol)]] = grammar_.start_symbol;
+
+    Grammar::Productions merged;
+    Grammar::Weights merged_weights;
+    for (auto& [lhs, rhses] : grammar_.productions) {
+        const auto& rep = representative.at(cls[id.at(lhs)]);
+        if (rep != lhs) continue;
+
+        for (auto& rhs : rhses) {
+            for (auto& sym : rhs) {
+                auto nt = id.find(sym);
+                if (nt != id.end()) {
+                    sym = representative.at(cls[nt->second]);
+                }
+            }
+        }
+
+        merged[lhs] = std::move(rhses);
+        if (weighted_) {
+            merged_weights[lhs] = std::move(grammar_.weights.at(lhs));
+        }
+    }
+
+    grammar_.productions = std::move(merged);
+    grammar_.weights = std::move(merged_weights);
+    grammar_.non_terminals.clear();
+    for (const auto& [_, rep] : representative) {
+        grammar_.non_terminals.insert(rep);
+    }
+
+    dedup_productions();
 }
 
 inline void ChomskyNormalForm::dedup_productions() {
     for (auto& [lhs, rhses] : grammar_.productions) {
-        std::ranges::sort(rhses);
-        auto [first, last] = std::ranges::unique(rhses);
-        rhses.erase(first, last);
+        if (!weighted_) {
+            std::ranges::sort(rhses);
+            auto [first, last] = std::ranges::unique(rhses);
+            rhses.erase(first, last);
+            continue;
+        }
+
+        // equal rules are alternative derivations of the same thing, so their weights add up
+        auto& weights = grammar_.weights.at(lhs);
+        const auto& list = rhses;
+
+        std::vector<size_t> order(rhses.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::ranges::stable_sort(order, {}, [&](size_t i) -> const Grammar::RHS& { return list[i]; });
+
+        std::vector<Grammar::RHS> unique_rhses;
+        std::vector<double> unique_weights;
+        for (size_t i : order) {
+            if (!unique_rhses.empty() && unique_rhses.back() == rhses[i]) {
+                unique_weights.back() += weights[i];
+            } else {
+                unique_rhses.push_back(std::move(rhses[i]));
+                unique_weights.push_back(weights[i]);
+            }
+        }
+
+        rhses = std::move(unique_rhses);
+        weights = std::move(unique_weights);
     }
 }
 
+template<typename Pred>
+inline void ChomskyNormalForm::erase_productions_if(
+    const Grammar::LHS& lhs,
+    std::vector<Grammar::RHS>& rhses,
+    Pred pred
+) {
+    if (!weighted_) {
+        std::erase_if(rhses, pred);
+        return;
+    }
+
+    auto& weights = grammar_.weights.at(lhs);
+    size_t kept = 0;
+
+    for (size_t i = 0; i < rhses.size(); ++i) {
+        if (pred(rhses[i])) continue;
+
+        if (kept != i) {
+            rhses[kept] = std::move(rhses[i]);
+            weights[kept] = weights[i];
+        }
+        ++kept;
+    }
+
+    rhses.resize(kept);
+    weights.resize(kept);
+}
+
 inline void ChomskyNormalForm::START() {
     std::string start_sym = fresh_non_terminal("S");
 
     grammar_.productions.insert({ start_sym, { { grammar_.start_symbol } } });
+    if (weighted_) {
+        grammar_.weights[start_sym] = { 1.0 };
+    }
     grammar_.start_symbol = start_sym;
 }
 
@@ -179,6 +404,9 @@ inline void ChomskyNormalForm::TERM() {
 
     for (const auto& [terminal, new_nt] : processed_terminals) {
         grammar_.productions.insert({ new_nt, {{ terminal }} });
+        if (weighted_) {
+            grammar_.weights[new_nt] = { 1.0 };
+        }
     }
 }
 
@@ -208,6 +436,9 @@ inline void ChomskyNormalForm::BIN() {
     for (auto& [non_term, rhss] : new_productions) {
         auto& dst = grammar_.productions[non_term];
         dst.insert(dst.end(), rhss.begin(), rhss.end());
+        if (weighted_) {
+            grammar_.weights[non_term].resize(dst.size(), 1.0);
+        }
     }
 }
 
@@ -253,9 +484,101 @@ inline void ChomskyNormalForm::DEL() {
         }
     }
 
+    // probability that a nullable symbol derives ε, the least fixpoint of
+    // e(A) = sum over A -> B1..Bk with every Bi nullable of p * e(B1) * ... * e(Bk).
+    // Plain iteration only creeps up on it for critical grammars like A -> A A (.5) | ε
+    // (.5), so this is Newton's method from 0, e += (I - F'(e))^-1 (F(e) - e), which
+    // approaches the least fixpoint from below and gains a bit per step even then
+    std::unordered_map<Grammar::Symbol, double> epsilon;
+    if (weighted_) {
+        const std::vector<Grammar::LHS> order(nullable.begin(), nullable.end());
+        std::unordered_map<Grammar::Symbol, size_t> index;
+        for (size_t i = 0; i < order.size(); ++i) {
+            index.emplace(order[i], i);
+        }
+
+        const size_t n = order.size();
+        std::vector<double> e(n, 0);
+        bool converged = n == 0;
+
+        for (int round = 0; round < 1000 && !converged; ++round) {
+            // [I - F'(e) | F(e) - e], solved in place by Gauss-Jordan elimination
+            std::vector<std::vector<double>> m(n, std::vector<double>(n + 1, 0));
+
+            for (size_t a = 0; a < n; ++a) {
+                const auto& rhses = grammar_.productions.at(order[a]);
+                const auto& weights = grammar_.weights.at(order[a]);
+
+                m[a][a] = 1;
+                m[a][n] = -e[a];
+
+                for (size_t i = 0; i < rhses.size(); ++i) {
+                    const auto& rhs = rhses[i];
+                    if (!std::ranges::all_of(rhs, [&](const auto& sym) { return index.contains(sym); })) {
+                        continue;
+                    }
+
+                    double term = weights[i];
+                    for (const auto& sym : rhs) term *= e[index.at(sym)];
+                    m[a][n] += term;
+
+                    // d term / d e(Bj), one occurrence at a time
+                    for (size_t j = 0; j < rhs.size(); ++j) {
+                        double derivative = weights[i];
+                        for (size_t k = 0; k < rhs.size(); ++k) {
+                            if (k != j) derivative *= e[index.at(rhs[k])];
+                        }
+                        m[a][index.at(rhs[j])] -= derivative;
+                    }
+                }
+            }
+
+            for (size_t col = 0; col < n; ++col) {
+                size_t pivot = col;
+                for (size_t row = col + 1; row < n; ++row) {
+                    if (std::abs(m[row][col]) > std::abs(m[pivot][col])) pivot = row;
+                }
+
+                if (std::abs(m[pivot][col]) < 1e-300) {
+                    throw std::runtime_error("ε-probabilities have no finite solution");
+                }
+
+                std::swap(m[pivot], m[col]);
+                const double inv = 1 / m[col][col];
+                for (auto& x : m[col]) x *= inv;
+
+                for (size_t row = 0; row < n; ++row) {
+                    if (row == col || m[row][col] == 0) continue;
+                    const double f = m[row][col];
+                    for (size_t k = col; k <= n; ++k) {
+                        m[row][k] -= f * m[col][k];
+                    }
+                }
+            }
+
+            double change = 0;
+            for (size_t a = 0; a < n; ++a) {
+                e[a] += m[a][n];
+                change = std::max(change, std::abs(m[a][n]));
+            }
+            converged = change <= 1e-15;
+        }
+
+        if (!converged) {
+            throw std::runtime_error("ε-probabilities did not converge");
+        }
+
+        for (size_t a = 0; a < n; ++a) {
+            epsilon[order[a]] = e[a];
+        }
+    }
+
+    // every way to drop nullable symbols, with the weight factor of each for weighted grammars
     auto generate_options = [&](const auto& rhs) {
         std::vector<Grammar::RHS> ans;
+        std::vector<double> scale;
         ans.push_back({});
+        scale.push_back(1.0);
 
         for (const auto& sym : rhs) {
             if (nullable.contains(sym)) {
@@ -266,6 +589,13 @@ inline void ChomskyNormalForm::DEL() {
                     ans[old_size + i] = ans[i];
                     ans[i].push_back(sym);
                 }
+
+                if (weighted_) {
+                    scale.resize(old_size * 2);
+                    for (size_t i = 0; i < old_size; ++i) {
+                        scale[old_size + i] = scale[i] * epsilon.at(sym);
+                    }
+                }
             } else {
                 for (auto& opt : ans) {
                     opt.push_back(sym);
@@ -273,7 +603,7 @@ inline void ChomskyNormalForm::DEL() {
             }
         }
 
-        return ans;
+        return std::make_pair(std::move(ans), std::move(scale));
     };
 
     for (auto& [lhs, rhsese] : grammar_.productions) {
@@ -281,7 +611,7 @@ inline void ChomskyNormalForm::DEL() {
         // for the love of god do not use iterators here
         for (size_t i = 0; i < rhs_count; ++i) {
             if (rhsese[i].empty()) continue;
-            auto answer = generate_options(rhsese[i]);
+            auto [answer, scale] = generate_options(rhsese[i]);
             // skip the first element from answer bc that's the original rhs
             // skip the last element if the rhs is epsilon, becase it will be {}
             // proof by trust me bro
@@ -293,6 +623,14 @@ inline void ChomskyNormalForm::DEL() {
             }
 
             if (first < last) {
+                if (weighted_) {
+                    auto& weights = grammar_.weights.at(lhs);
+                    const double p = weights[i];
+                    for (auto it = first; it != last; ++it) {
+                        weights.push_back(p * scale[it - answer.begin()]);
+                    }
+                }
+
                 rhsese.insert(rhsese.end(), first, last);
             }
         }
@@ -304,7 +642,7 @@ inline void ChomskyNormalForm::DEL() {
             continue;
         }
 
-        std::erase_if(rhses, [](const auto& rhs) {
+        erase_productions_if(lhs, rhses, [](const auto& rhs) {
             return rhs.empty();
         });
     }
@@ -327,21 +665,84 @@ inline void ChomskyNormalForm::UNIT() {
         }
     }
 
+    // weighted grammars: chain[A][B] is the total weight of all unit chains A =>* B,
+    // i.e. (I - M)^-1 for M[A][B] = weight of A -> B, found by Gauss-Jordan elimination
+    std::unordered_map<std::string, size_t> unit_index;
+    std::vector<std::vector<double>> chain;
+
+    if (weighted_) {
+        for (const auto& [from, targets] : unit_graph) {
+            unit_index.try_emplace(from, unit_index.size());
+            for (const auto& to : targets) {
+                unit_index.try_emplace(to, unit_index.size());
+            }
+        }
+
+        const size_t n = unit_index.size();
+        std::vector<std::vector<double>> m(n, std::vector<double>(2 * n, 0));
+        for (size_t i = 0; i < n; ++i) {
+            m[i][i] = 1;
+            m[i][n + i] = 1;
+        }
+
+        for (const auto& [lhs, rhses] : grammar_.productions) {
+            const auto& weights = grammar_.weights.at(lhs);
+            for (size_t i = 0; i < rhses.size(); ++i) {
+                if (is_unit_edge(rhses[i])) {
+                    m[unit_index.at(lhs)][unit_index.at(rhses[i][0])] -= weights[i];
+                }
+            }
+        }
+
+        for (size_t col = 0; col < n; ++col) {
+            size_t pivot = col;
+            for (size_t row = col + 1; row < n; ++row) {
+                if (std::abs(m[row][col]) > std::abs(m[pivot][col])) pivot = row;
+            }
+
+            if (std::abs(m[pivot][col]) < 1e-12) {
+                throw std::runtime_error("Unit rules form a cycle of probability 1");
+            }
+
+            std::swap(m[pivot], m[col]);
+            const double inv = 1 / m[col][col];
+            for (auto& x : m[col]) x *= inv;
+
+            for (size_t row = 0; row < n; ++row) {
+                if (row == col || m[row][col] == 0) continue;
+                const double f = m[row][col];
+                for (size_t k = col; k < 2 * n; ++k) {
+                    m[row][k] -= f * m[col][k];
+                }
+            }
+        }
+
+        chain.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            chain[i].assign(m[i].begin() + n, m[i].end());
+        }
+    }
+
     const auto& grammar = grammar_;
     auto dfs = [&](
         auto&& self,
         const std::string& node,
         std::unordered_set<std::string>& visited,
-        std::vector<Grammar::RHS>& ans
+        std::vector<Grammar::RHS>& ans,
+        std::vector<std::pair<const Grammar::LHS*, size_t>>& sources
     ) -> void {
         if (visited.contains(node)) return;
         visited.insert(node);
 
         auto pit = grammar.productions.find(node);
         if (pit != grammar.productions.end()) {
-            for (const auto& rhs : pit->second) {
+            for (size_t i = 0; i < pit->second.size(); ++i) {
+                const auto& rhs = pit->second[i];
                 if (!is_unit_edge(rhs)) {
                     ans.push_back(rhs);
+                    if (weighted_) {
+                        sources.push_back({ &pit->first, i });
+                    }
                 }
             }
         }
@@ -349,20 +750,36 @@ inline void ChomskyNormalForm::UNIT() {
         auto it = unit_graph.find(node);
         if (it != unit_graph.end()) {
             for (auto& child : it->second) {
-                self(self, child, visited, ans);
+                self(self, child, visited, ans, sources);
             }
         }
     };
 
     Grammar::Productions new_productions;
+    Grammar::Weights new_weights;
+
     for (const auto& [lhs, _] : grammar_.productions) {
         std::vector<Grammar::RHS> new_rhses;
+        std::vector<std::pair<const Grammar::LHS*, size_t>> sources;
         std::unordered_set<std::string> visited;
-        dfs(dfs, lhs, visited, new_rhses);
+        dfs(dfs, lhs, visited, new_rhses, sources);
         new_productions[lhs] = std::move(new_rhses);
+
+        if (weighted_) {
+            auto& weights = new_weights[lhs];
+            for (const auto& [node, i] : sources) {
+                const double factor = !unit_index.contains(lhs)
+                    ? 1.0
+                    : chain[unit_index.at(lhs)][unit_index.at(*node)];
+                weights.push_back(factor * grammar_.weights.at(*node)[i]);
+            }
+        }
     }
 
     grammar_.productions = std::move(new_productions);
+    if (weighted_) {
+        grammar_.weights = std::move(new_weights);
+    }
 }
 
 
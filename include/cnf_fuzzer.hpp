@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chomsky_normal_form.hpp"
+#include "cyk.hpp"
+#include "derivation_search.hpp"
+#include "earley.hpp"
+#include "lalr_parser.hpp"
+#include "language_counter.hpp"
+
+// Differential fuzzer for ChomskyNormalForm::normalize.
+//
+// Every random grammar is normalized and both versions are asked about the same words:
+// Earley on the original grammar is the reference, CYK on the normalized one is the
+// grammar under test. The words are every string over the terminals up to
+// max_word_length, plus longer words sampled from the normalized grammar so that
+// positives are covered too. A result that is not in CNF counts as a failure as well,
+// and so does DerivationSearch on the original grammar not finding exactly the short
+// words Earley accepts. The LALR(1) parser of the original grammar has to agree with
+// Earley when it has no conflicts, and must at least halt on every word when it does.
+//
+// Grammar i is generated from seed + i alone, so a run is reproducible no matter how
+// the work is split between threads. Failing grammars are shrunk greedily (drop a
+// production, drop a symbol from a right hand side, drop a non-terminal) while they
+// keep failing. Each failure names the component it points at, and is shrunk against
+// that component's checks alone, so a LALR(1) or DerivationSearch bug is not reported
+// as a CNF one (or shrunk into one).
+
+struct FuzzOptions {
+    size_t grammars = 1000;
+    uint64_t seed = 1;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    size_t non_terminals = 5;
+    size_t terminals = 2;
+    size_t max_alternatives = 3;
+    size_t max_rhs_length = 4;
+
+    size_t max_word_length = 6;
+    size_t sampled_length = 12;
+    size_t samples = 16;
+
+    // stop early once this many failures were found
+    size_t max_failures = 1;
+};
+
+// the part of the pipeline a failure points at
+enum class FuzzComponent { CNF, LALR, DerivationSearch };
+
+struct FuzzFinding {
+    FuzzComponent component;
+    std::string reason;
+};
+
+struct FuzzFailure {
+    uint64_t seed;
+    FuzzComponent component;
+    Grammar grammar;
+    // the result of normalize() on grammar, only of interest for CNF failures
+    Grammar normalized;
+    std::string reason;
+};
+
+struct FuzzReport {
+    size_t grammars = 0;
+    size_t words = 0;
+    double seconds = 0;
+    std::vector<FuzzFailure> failures;
+
+    double grammars_per_second() const { return seconds > 0 ? grammars / seconds : 0; }
+};
+
+class CNFFuzzer {
+public:
+    explicit CNFFuzzer(FuzzOptions options = {})
+        : options_{std::move(options)} {};
+
+    FuzzReport run() const;
+
+    Grammar random_grammar(uint64_t seed) const;
+
+    // what the grammar fails on, or nullopt if every component handled it; with only
+    // set, the checks of the other components are skipped
+    std::optional<FuzzFinding> check(
+        const Grammar& g,
+        size_t* words = nullptr,
+        std::optional<FuzzComponent> only = std::nullopt
+    ) const;
+
+    // a smaller grammar that still fails the checks of component
+    Grammar shrink(Grammar g, FuzzComponent component) const;
+
+private:
+    FuzzOptions options_;
+};
+
+inline Grammar CNFFuzzer::random_grammar(uint64_t seed) const {
+    std::mt19937_64 rng(seed);
+    auto chance = [&](unsigned percent) { return rng() % 100 < percent; };
+
+    Grammar g;
+    g.start_symbol = "S";
+
+    std::vector<Grammar::Symbol> non_terminals = { "S" };
+    for (size_t i = 1; i < options_.non_terminals; ++i) {
+        non_terminals.push_back(std::string(1, static_cast<char>('A' + i - 1)));
+    }
+
+    std::vector<Grammar::Symbol> terminals;
+    for (size_t i = 0; i < options_.terminals; ++i) {
+        terminals.push_back(std::string(1, static_cast<char>('a' + i)));
+    }
+
+    g.non_terminals.insert(non_terminals.begin(), non_terminals.end());
+    g.terminals.insert(terminals.begin(), terminals.end());
+
+    // the last non-terminal is never used on a right hand side, like E in lab 5
+    const size_t used = non_terminals.size() > 2 && chance(50) ? non_terminals.size() - 1 : non_terminals.size();
+
+    auto pick = [&](const std::vector<Grammar::Symbol>& from, size_t n) {
+        return from[rng() % n];
+    };
+
+    for (const auto& lhs : non_terminals) {
+        auto& rhses = g.productions[lhs];
+        const size_t alternatives = 1 + rng() % options_.max_alternatives;
+
+        for (size_t i = 0; i < alternatives; ++i) {
+            Grammar::RHS rhs;
+
+            if (chance(15)) {
+                // ε-rule, left empty
+            } else if (chance(20)) {
+                // unit rule, these chain into cycles often enough
+                rhs.push_back(pick(non_terminals, used));
+            } else {
+                const size_t length = 1 + rng() % options_.max_rhs_length;
+                for (size_t j = 0; j < length; ++j) {
+                    rhs.push_back(chance(50) ? pick(terminals, terminals.size()) : pick(non_terminals, used));
+                }
+            }
+
+            rhses.push_back(std::move(rhs));
+        }
+    }
+
+    return g;
+}
+
+inline std::optional<FuzzFinding> CNFFuzzer::check(
+    const Grammar& g,
+    size_t* words,
+    std::optional<FuzzComponent> only
+) const {
+    auto wanted = [&](FuzzComponent component) { return !only || *only == component; };
+
+    ChomskyNormalForm chomsky_normal_form(g);
+    chomsky_normal_form.normalize();
+    const Grammar cnf = chomsky_normal_form.result();
+
+    if (wanted(FuzzComponent::CNF) && !is_cnf(cnf)) {
+        return FuzzFinding{ FuzzComponent::CNF, "normalized grammar is not in CNF" };
+    }
+
+    EarleyParser reference(g);
+    CYKParser tested(cnf, 1);
+    LALRParser lalr(g);
+
+    std::vector<Grammar::Symbol> terminals(g.terminals.begin(), g.terminals.end());
+    std::vector<Grammar::Symbol> word;
+    size_t checked = 0;
+    // the words up to max_word_length in the language
+    std::set<std::string> accepted;
+
+    auto compare = [&](const std::vector<Grammar::Symbol>& w) -> std::optional<FuzzFinding> {
+        ++checked;
+
+        std::string text;
+        for (const auto& sym : w) text += sym;
+
+        const bool expected = reference.recognize(w);
+        if (expected && w.size() <= options_.max_word_length) {
+            accepted.insert(text);
+        }
+        if (wanted(FuzzComponent::CNF) && expected != tested.recognize(w)) {
+            return FuzzFinding{ FuzzComponent::CNF,
+                                "\"" + text + "\" is " + (expected ? "in" : "not in") + " the original language but " +
+                                (expected ? "rejected" : "accepted") + " after normalization" };
+        }
+
+        // refused and non-terminating parses throw, a hang here is the failure
+        try {
+            if (wanted(FuzzComponent::LALR) && lalr.recognize(w) != expected && lalr.is_lalr1()) {
+                return FuzzFinding{ FuzzComponent::LALR,
+                                    "LALR(1) " + std::string(expected ? "rejects" : "accepts") + " \"" + text + "\"" };
+            }
+        } catch (const std::runtime_error&) {
+        }
+
+        return std::nullopt;
+    };
+
+    // odometer over all words up to max_word_length
+    std::vector<size_t> digits;
+    while (digits.size() <= options_.max_word_length) {
+        word.clear();
+        for (size_t d : digits) word.push_back(terminals[d]);
+
+        if (auto finding = compare(word)) {
+            if (words) *words += checked;
+            return finding;
+        }
+
+        if (terminals.empty()) break;
+
+        size_t i = 0;
+        while (i < digits.size() && ++digits[i] == terminals.size()) {
+            digits[i++] = 0;
+        }
+        if (i == digits.size()) {
+            digits.push_back(0);
+        }
+    }
+
+    if (wanted(FuzzComponent::DerivationSearch)) {
+        const auto derived = DerivationSearch(g, 1).enumerate(options_.max_word_length);
+        const std::set<std::string> found(derived.begin(), derived.end());
+
+        auto finding = [&](std::string reason) {
+            if (words) *words += checked;
+            return FuzzFinding{ FuzzComponent::DerivationSearch, std::move(reason) };
+        };
+        for (const auto& w : accepted) {
+            if (!found.contains(w)) return finding("derivation search misses \"" + w + "\"");
+        }
+        for (const auto& w : found) {
+            if (!accepted.contains(w)) return finding("derivation search finds \"" + w + "\", not in the language");
+        }
+    }
+
+    if (options_.sampled_length <= options_.max_word_length) {
+        if (words) *words += checked;
+        return std::nullopt;
+    }
+
+    LanguageCounter counter(cnf, options_.sampled_length);
+    std::mt19937_64 rng(options_.seed);
+
+    for (size_t i = 0; i < options_.samples; ++i) {
+        const size_t length = options_.max_word_length + 1 + rng() % (options_.sampled_length - options_.max_word_length);
+
+        auto sampled = counter.sample_tree(length, rng);
+        if (!sampled) continue;
+
+        // terminals are single characters here, so the sample splits back cleanly
+        if (auto finding = compare(to_symbols(*sampled))) {
+            if (words) *words += checked;
+            return finding;
+        }
+    }
+
+    if (words) *words += checked;
+    return std::nullopt;
+}
+
+inline Grammar CNFFuzzer::shrink(Grammar g, FuzzComponent component) const {
+    auto fails = [&](const Grammar& candidate) { return check(candidate, nullptr, component).has_value(); };
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        // drop a whole non-terminal along with every rule that mentions it
+        for (const auto& nt : std::set<Grammar::Symbol>(g.non_terminals)) {
+            if (nt == g.start_symbol) continue;
+
+            Grammar candidate = g;
+            candidate.non_terminals.erase(nt);
+            candidate.productions.erase(nt);
+            for (auto& [lhs, rhses] : candidate.productions) {
+                std::erase_if(rhses, [&](const auto& rhs) { return std::ranges::find(rhs, nt) != rhs.end(); });
+            }
+
+            if (fails(candidate)) {
+                g = std::move(candidate);
+                changed = true;
+            }
+        }
+
+        // drop a single production
+        for (const auto& lhs : std::set<Grammar::Symbol>(g.non_terminals)) {
+            for (size_t i = 0; g.productions.contains(lhs) && i < g.productions[lhs].size();) {
+                Grammar candidate = g;
+                candidate.productions[lhs].erase(candidate.productions[lhs].begin() + i);
+
+                if (fails(candidate)) {
+                    g = std::move(candidate);
+                    changed = true;
+                } else {
+                    ++i;
+                }
+            }
+        }
+
+        // drop a single symbol from a right hand side
+        for (const auto& lhs : std::set<Grammar::Symbol>(g.non_terminals)) {
+            if (!g.productions.contains(lhs)) continue;
+
+            for (size_t i = 0; i < g.productions[lhs].size(); ++i) {
+                for (size_t j = 0; j < g.productions[lhs][i].size();) {
+                    Grammar candidate = g;
+                    auto& rhs = candidate.productions[lhs][i];
+                    rhs.erase(rhs.begin() + j);
+
+                    if (fails(candidate)) {
+                        g = std::move(candidate);
+                        changed = true;
+                    } else {
+                        ++j;
+                    }
+                }
+            }
+        }
+    }
+
+    return g;
+}
+
+inline FuzzReport CNFFuzzer::run() const {
+    FuzzReport report;
+    std::mutex mutex;
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> done = 0;
+    std::atomic<size_t> words = 0;
+    std::atomic<bool> stop = false;
+
+    auto worker = [&]() {
+        size_t checked = 0;
+
+        while (!stop.load(std::memory_order_relaxed)) {
+            const size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= options_.grammars) break;
+
+            const uint64_t seed = options_.seed + i;
+            const Grammar g = random_grammar(seed);
+            auto finding = check(g, &checked);
+            done.fetch_add(1, std::memory_order_relaxed);
+
+            if (!finding) continue;
+
+            const FuzzComponent component = finding->component;
+            Grammar minimal = shrink(g, component);
+            ChomskyNormalForm chomsky_normal_form(minimal);
+            chomsky_normal_form.normalize();
+            std::string reason = check(minimal, nullptr, component)->reason;
+
+            std::lock_guard lock(mutex);
+            if (report.failures.size() < options_.max_failures) {
+                report.failures.push_back({ seed, component, minimal, chomsky_normal_form.result(), std::move(reason) });
+            }
+            if (report.failures.size() >= options_.max_failures) {
+                stop = true;
+            }
+        }
+
+        words.fetch_add(checked, std::memory_order_relaxed);
+    };
+
+    const auto begin = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < options_.threads; ++t) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    report.grammars = done;
+    report.words = words;
+
+    std::ranges::sort(report.failures, {}, &FuzzFailure::seed);
+    return report;
+}
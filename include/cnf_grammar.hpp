@@ -13,11 +13,17 @@ struct Grammar {
     using RHS = std::vector<Symbol>;
     using LHS = Symbol;
     using Productions = std::unordered_map<LHS, std::vector<RHS>>;
+    using Weights = std::unordered_map<LHS, std::vector<double>>;
 
     Symbol start_symbol;
     std::set<Symbol> non_terminals;
     std::set<Symbol> terminals;
     Productions productions;
+    // optional rule probabilities, weights[A][i] belongs to productions[A][i];
+    // left empty for an unweighted grammar
+    Weights weights;
+
+    bool is_weighted() const { return !weights.empty(); }
 
     void print_grammar(std::ostream& os = std::cout) const {
         os << "Start symbol: " << start_symbol << "\n";
@@ -54,6 +60,7 @@ struct Grammar {
 
         for (const auto& lhs : lhs_list) {
             const auto& rhses = productions.at(lhs);
+            auto wit = weights.find(lhs);
 
             os << lhs << " -> ";
 
@@ -72,6 +79,10 @@ struct Grammar {
                             os << rhs[j];
                         }
                     }
+
+                    if (wit != weights.end() && i < wit->second.size()) {
+                        os << " (" << wit->second[i] << ')';
+                    }
                 }
             }
 
@@ -195,6 +206,16 @@ static inline std::string to_terminal_string(const Grammar& g, const std::vector
     return out;
 }
 
+// splits a word into single character terminals
+static inline std::vector<std::string> to_symbols(const std::string& word) {
+    std::vector<std::string> out;
+    out.reserve(word.size());
+    for (char c : word) {
+        out.emplace_back(1, c);
+    }
+    return out;
+}
+
 struct CNFCheckResult {
     bool cnf_ok;
 };
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "regex_ast.hpp"
+
+// Glushkov automaton with counters for bounded repetition.
+//
+// RegexPositions expands r^n into n copies of r, so (ab)^10000 takes 20000 positions.
+// Here a repeat only gets expanded while that stays small, up to MAX_UNROLL positions:
+// the copies are just more positions, one word each in the configuration vectors
+// below, where a counter would add a value to every configuration inside the repeat
+// and longer compares to every sort. A larger one keeps a single copy of r plus a
+// counter that holds the number of the iteration the match is in, from 1 to n.
+//
+// A configuration is a position together with the values of the counters of the
+// repeats around it, outermost first. Every followpos edge comes from some node X of
+// the regex and knows how many counters of its source lie below X (the repeats it
+// leaves) and how many of its target do (the repeats it enters):
+//
+//   - every left counter must be done: at n, or anywhere if r is nullable since the
+//     remaining iterations can then match ε
+//   - every entered counter starts at 1
+//   - the edge back from lastpos(r) to firstpos(r) of a counted repeat increments its
+//     counter, and is only taken below n
+//
+// The matcher keeps the set of configurations after each character, sorted and
+// deduplicated. Memory is proportional to the regex plus the configurations alive at
+// once, which for the usual counter-unambiguous pattern is about one per position.
+
+class CountingNFA {
+public:
+    explicit CountingNFA(const RegexAST& ast);
+
+    size_t position_count() const { return symbol_.size(); }
+    size_t counter_count() const { return limit_.size(); }
+    // heap memory held, roughly
+    size_t byte_size() const;
+
+    // whether some repeat of the regex is too large to expand and would get a counter
+    static bool needs_counters(const RegexAST& ast);
+
+    bool matches(std::string_view input) const;
+
+private:
+    // repeats with a body of at most this many positions in total get expanded
+    static constexpr size_t MAX_UNROLL = 256;
+
+    struct Edge {
+        uint32_t to;
+        // outer counters carried over unchanged (the innermost of them incremented);
+        // the source's other counters are left and the target's others entered
+        uint32_t kept;
+        bool increment;
+    };
+
+    struct Info {
+        bool nullable = true;
+        std::vector<uint32_t> first;
+        std::vector<uint32_t> last;
+        uint32_t begin = 0;
+        uint32_t end = 0;
+    };
+
+    Info concat(Info left, Info right);
+    void connect(const std::vector<uint32_t>& from, const std::vector<uint32_t>& to, bool increment);
+    Info repeat(Info inner, uint32_t count);
+
+    bool done(uint32_t counter, uint32_t value) const {
+        return value == limit_[counter] || nullable_body_[counter];
+    }
+
+    // configurations are runs of [position, counter values...] in a flat buffer
+    void step(std::span<const uint32_t> current, char c, std::vector<uint32_t>& next) const;
+    static void normalize(std::vector<uint32_t>& configs, const std::vector<uint32_t>& depth);
+
+    std::vector<char> symbol_;
+    std::vector<std::vector<Edge>> edges_;
+    // counted repeats around each position, outermost first
+    std::vector<std::vector<uint32_t>> counters_;
+    std::vector<uint32_t> depth_;
+
+    std::vector<uint32_t> limit_;
+    std::vector<bool> nullable_body_;
+
+    std::vector<uint32_t> first_;
+    std::vector<bool> last_;
+    bool nullable_ = false;
+};
+
+inline void CountingNFA::connect(const std::vector<uint32_t>& from, const std::vector<uint32_t>& to, bool increment) {
+    // the counters collected so far are exactly the ones below the node making the
+    // edge; kept holds their number until the constructor turns it around
+    for (uint32_t p : from) {
+        for (uint32_t q : to) {
+            edges_[p].push_back({ q, static_cast<uint32_t>(counters_[p].size()), increment });
+        }
+    }
+}
+
+inline CountingNFA::Info CountingNFA::concat(Info left, Info right) {
+    connect(left.last, right.first, false);
+
+    Info out{ left.nullable && right.nullable, std::move(left.first), std::move(right.last) };
+    if (left.nullable) {
+        out.first.insert(out.first.end(), right.first.begin(), right.first.end());
+    }
+    if (right.nullable) {
+        out.last.insert(out.last.end(), left.last.begin(), left.last.end());
+    }
+    return out;
+}
+
+inline CountingNFA::Info CountingNFA::repeat(Info inner, uint32_t count) {
+    if (count == 0) {
+        return Info{};
+    }
+
+    const size_t size = inner.end - inner.begin;
+    if (size * count <= MAX_UNROLL) {
+        // the same block copying as RegexPositions, edges and counters go along
+        std::vector<Info> copies;
+        for (uint32_t k = 1; k < count; ++k) {
+            const uint32_t shift = symbol_.size() - inner.begin;
+            Info copy{ inner.nullable, inner.first, inner.last, 0, 0 };
+
+            for (uint32_t p = inner.begin; p < inner.end; ++p) {
+                symbol_.push_back(symbol_[p]);
+                edges_.push_back(edges_[p]);
+                counters_.push_back(counters_[p]);
+                for (Edge& e : edges_.back()) e.to += shift;
+            }
+            for (uint32_t& p : copy.first) p += shift;
+            for (uint32_t& p : copy.last) p += shift;
+
+            copies.push_back(std::move(copy));
+        }
+
+        for (auto& copy : copies) {
+            inner = concat(std::move(inner), std::move(copy));
+        }
+        return inner;
+    }
+
+    const uint32_t counter = limit_.size();
+    limit_.push_back(count);
+    nullable_body_.push_back(inner.nullable);
+
+    connect(inner.last, inner.first, true);
+    for (uint32_t p = inner.begin; p < inner.end; ++p) {
+        counters_[p].push_back(counter);
+    }
+    return inner;
+}
+
+inline CountingNFA::CountingNFA(const RegexAST& ast) {
+    std::vector<Info> infos(ast.size());
+
+    for (uint32_t i = 0; i < ast.size(); ++i) {
+        const RegexNode& node = ast[i];
+        const uint32_t begin = symbol_.size();
+        Info info;
+
+        uint32_t block = begin;
+        if (node.type == RegexNodeType::Concat) {
+            block = infos[ast.children_of(node).front()].begin;
+        } else if (node.type != RegexNodeType::Literal) {
+            block = infos[node.left].begin;
+        }
+
+        switch (node.type) {
+            case RegexNodeType::Literal:
+                symbol_.push_back(node.ch);
+                edges_.emplace_back();
+                counters_.emplace_back();
+                info = Info{ false, { begin }, { begin } };
+                break;
+
+            case RegexNodeType::Concat:
+                for (uint32_t child : ast.children_of(node)) {
+                    info = concat(std::move(info), std::move(infos[child]));
+                }
+                break;
+
+            case RegexNodeType::Or: {
+                info = std::move(infos[node.left]);
+                Info& right = infos[node.right];
+
+                info.nullable = info.nullable || right.nullable;
+                info.first.insert(info.first.end(), right.first.begin(), right.first.end());
+                info.last.insert(info.last.end(), right.last.begin(), right.last.end());
+                break;
+            }
+
+            case RegexNodeType::Star:
+            case RegexNodeType::Plus:
+                info = std::move(infos[node.left]);
+                connect(info.last, info.first, false);
+                info.nullable = info.nullable || node.type == RegexNodeType::Star;
+                break;
+
+            case RegexNodeType::Repeat:
+                info = repeat(std::move(infos[node.left]), node.right);
+                break;
+
+            case RegexNodeType::QMark:
+                info = std::move(infos[node.left]);
+                info.nullable = true;
+                break;
+        }
+
+        info.begin = block;
+        info.end = symbol_.size();
+        infos[i] = std::move(info);
+    }
+
+    // counters were collected innermost first, and the edges counted from that end
+    for (auto& counters : counters_) {
+        std::ranges::reverse(counters);
+        depth_.push_back(counters.size());
+    }
+    for (uint32_t p = 0; p < edges_.size(); ++p) {
+        for (Edge& e : edges_[p]) {
+            e.kept = depth_[p] - e.kept;
+        }
+    }
+
+    Info& root = infos[ast.root];
+    first_ = std::move(root.first);
+    std::ranges::sort(first_);
+    first_.erase(std::unique(first_.begin(), first_.end()), first_.end());
+
+    last_.assign(symbol_.size(), false);
+    for (uint32_t p : root.last) last_[p] = true;
+    nullable_ = root.nullable;
+}
+
+inline size_t CountingNFA::byte_size() const {
+    size_t bytes = symbol_.size() + depth_.size() * sizeof(uint32_t) + limit_.size() * sizeof(uint32_t)
+                 + first_.size() * sizeof(uint32_t) + (last_.size() + nullable_body_.size()) / 8;
+    for (const auto& edges : edges_) bytes += edges.size() * sizeof(Edge);
+    for (const auto& counters : counters_) bytes += counters.size() * sizeof(uint32_t);
+    return bytes;
+}
+
+inline bool CountingNFA::needs_counters(const RegexAST& ast) {
+    // positions of each node after the same unrolling the constructor does
+    std::vector<size_t> size(ast.size());
+    for (uint32_t i = 0; i < ast.size(); ++i) {
+        const RegexNode& node = ast[i];
+        switch (node.type) {
+            case RegexNodeType::Literal:
+                size[i] = 1;
+                break;
+            case RegexNodeType::Concat:
+                for (uint32_t child : ast.children_of(node)) size[i] += size[child];
+                break;
+            case RegexNodeType::Or:
+                size[i] = size[node.left] + size[node.right];
+                break;
+            case RegexNodeType::Star:
+            case RegexNodeType::Plus:
+            case RegexNodeType::QMark:
+                size[i] = size[node.left];
+                break;
+            case RegexNodeType::Repeat:
+                if (node.right == 0) break;
+                if (size[node.left] * node.right > MAX_UNROLL) return true;
+                size[i] = size[node.left] * node.right;
+                break;
+        }
+    }
+    return false;
+}
+
+inline void CountingNFA::step(std::span<const uint32_t> current, char c, std::vector<uint32_t>& next) const {
+    for (size_t at = 0; at < current.size(); ) {
+        const uint32_t p = current[at];
+        const uint32_t* values = &current[at + 1];
+        at += 1 + depth_[p];
+
+        for (const Edge& e : edges_[p]) {
+            if (symbol_[e.to] != c) continue;
+
+            const uint32_t kept = e.kept;
+
+            bool ok = true;
+            for (uint32_t k = kept; k < depth_[p] && ok; ++k) {
+                ok = done(counters_[p][k], values[k]);
+            }
+            if (e.increment && values[kept - 1] >= limit_[counters_[p][kept - 1]]) {
+                ok = false;
+            }
+            if (!ok) continue;
+
+            next.push_back(e.to);
+            next.insert(next.end(), values, values + kept);
+            if (e.increment) {
+                ++next.back();
+            }
+            next.insert(next.end(), depth_[e.to] - kept, 1);
+        }
+    }
+}
+
+inline void CountingNFA::normalize(std::vector<uint32_t>& configs, const std::vector<uint32_t>& depth) {
+    std::vector<uint32_t> starts;
+    for (size_t at = 0; at < configs.size(); at += 1 + depth[configs[at]]) {
+        starts.push_back(at);
+    }
+
+    auto view = [&](uint32_t at) {
+        return std::span<const uint32_t>(&configs[at], 1 + depth[configs[at]]);
+    };
+
+    std::ranges::sort(starts, [&](uint32_t a, uint32_t b) {
+        return std::ranges::lexicographical_compare(view(a), view(b));
+    });
+
+    std::vector<uint32_t> out;
+    out.reserve(configs.size());
+    for (size_t i = 0; i < starts.size(); ++i) {
+        if (i > 0 && std::ranges::equal(view(starts[i]), view(starts[i - 1]))) continue;
+
+        auto v = view(starts[i]);
+        out.insert(out.end(), v.begin(), v.end());
+    }
+    configs.swap(out);
+}
+
+inline bool CountingNFA::matches(std::string_view input) const {
+    if (input.empty()) {
+        return nullable_;
+    }
+
+    std::vector<uint32_t> current;
+    std::vector<uint32_t> next;
+
+    // the first character enters from outside everything, all counters start at 1
+    for (uint32_t q : first_) {
+        if (symbol_[q] != input[0]) continue;
+        current.push_back(q);
+        current.insert(current.end(), depth_[q], 1);
+    }
+
+    for (size_t i = 1; i < input.size() && !current.empty(); ++i) {
+        next.clear();
+        step(current, input[i], next);
+        normalize(next, depth_);
+        current.swap(next);
+    }
+
+    for (size_t at = 0; at < current.size(); ) {
+        const uint32_t p = current[at];
+        const uint32_t* values = &current[at + 1];
+        at += 1 + depth_[p];
+
+        if (!last_[p]) continue;
+
+        bool ok = true;
+        for (uint32_t k = 0; k < depth_[p] && ok; ++k) {
+            ok = done(counters_[p][k], values[k]);
+        }
+        if (ok) return true;
+    }
+    return false;
+}
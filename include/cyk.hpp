@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "cnf_grammar.hpp"
+
+// CYK over the grammars produced by ChomskyNormalForm::normalize.
+//
+// Every non-terminal gets a dense id and a chart cell is a bitset over those ids.
+// Cells of the upper triangle are stored in square tiles (TILE x TILE cells laid
+// out contiguously), so the row/column walks of the split loop stay inside a few
+// tiles instead of striding across the whole chart.
+//
+// Cells of the same span length do not depend on each other, so the chart is filled
+// one anti-diagonal at a time: the cells of a diagonal are handed out to the worker
+// threads in chunks and a barrier separates consecutive diagonals.
+
+struct CompiledCNF {
+    struct BinaryRule {
+        uint32_t lhs;
+        uint32_t right;
+    };
+
+    explicit CompiledCNF(const Grammar& cnf);
+
+    uint32_t id_of(const Grammar::Symbol& non_terminal) const {
+        auto it = ids.find(non_terminal);
+        return it == ids.end() ? UINT32_MAX : it->second;
+    }
+
+    std::vector<Grammar::Symbol> non_terminals;
+    std::unordered_map<Grammar::Symbol, uint32_t> ids;
+
+    // terminal -> every A with A -> terminal
+    std::unordered_map<Grammar::Symbol, std::vector<uint32_t>> terminal_rules;
+    // left child B -> every (A, C) with A -> B C
+    std::vector<std::vector<BinaryRule>> binary_rules;
+
+    uint32_t start = 0;
+    bool accepts_empty = false;
+};
+
+inline CompiledCNF::CompiledCNF(const Grammar& cnf) {
+    if (!is_cnf(cnf)) {
+        throw std::runtime_error("CYK requires a grammar in Chomsky normal form");
+    }
+
+    non_terminals.assign(cnf.non_terminals.begin(), cnf.non_terminals.end());
+    for (uint32_t i = 0; i < non_terminals.size(); ++i) {
+        ids[non_terminals[i]] = i;
+    }
+
+    binary_rules.resize(non_terminals.size());
+    start = ids.at(cnf.start_symbol);
+
+    for (const auto& [lhs, rhses] : cnf.productions) {
+        uint32_t a = ids.at(lhs);
+
+        for (const auto& rhs : rhses) {
+            if (rhs.empty()) {
+                accepts_empty = true;
+            } else if (rhs.size() == 1) {
+                terminal_rules[rhs[0]].push_back(a);
+            } else {
+                binary_rules[ids.at(rhs[0])].push_back({ a, ids.at(rhs[1]) });
+            }
+        }
+    }
+}
+
+class CYKParser {
+public:
+    explicit CYKParser(
+        const Grammar& cnf,
+        unsigned threads = std::thread::hardware_concurrency()
+    ) : grammar_{cnf}, threads_{std::max(1u, threads)} {};
+
+    bool recognize(const std::vector<Grammar::Symbol>& input) const;
+    bool recognize(const std::string& input) const {
+        return recognize(to_symbols(input));
+    }
+
+private:
+    static constexpr size_t TILE = 16;
+    // below this many tokens spawning workers costs more than the chart itself
+    static constexpr size_t PARALLEL_THRESHOLD = 64;
+    static constexpr size_t CHUNK = 8;
+
+    class Chart;
+
+    void fill_cell(Chart& chart, size_t i, size_t j) const;
+
+    CompiledCNF grammar_;
+    unsigned threads_;
+};
+
+class CYKParser::Chart {
+public:
+    Chart(size_t n, size_t non_terminals)
+        : words_{(non_terminals + 63) / 64},
+          tiles_{(n + TILE - 1) / TILE},
+          cells_(tiles_ * (tiles_ + 1) / 2 * TILE * TILE * words_, 0) {};
+
+    // cell for the span [i, j], i <= j
+    uint64_t* cell(size_t i, size_t j) {
+        return cells_.data() + offset(i, j);
+    }
+
+    const uint64_t* cell(size_t i, size_t j) const {
+        return cells_.data() + offset(i, j);
+    }
+
+    size_t words() const { return words_; }
+
+private:
+    size_t offset(size_t i, size_t j) const {
+        size_t ti = i / TILE;
+        size_t tj = j / TILE;
+        // tiles of the upper triangle, row by row
+        size_t tile = ti * tiles_ - ti * (ti - 1) / 2 + (tj - ti);
+        return ((tile * TILE + i % TILE) * TILE + j % TILE) * words_;
+    }
+
+    size_t words_;
+    size_t tiles_;
+    std::vector<uint64_t> cells_;
+};
+
+inline void CYKParser::fill_cell(Chart& chart, size_t i, size_t j) const {
+    uint64_t* out = chart.cell(i, j);
+    const size_t words = chart.words();
+
+    for (size_t k = i; k < j; ++k) {
+        const uint64_t* left = chart.cell(i, k);
+        const uint64_t* right = chart.cell(k + 1, j);
+
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t bits = left[w];
+
+            while (bits) {
+                size_t b = w * 64 + std::countr_zero(bits);
+                bits &= bits - 1;
+
+                for (const auto& rule : grammar_.binary_rules[b]) {
+                    if (right[rule.right / 64] >> (rule.right % 64) & 1) {
+                        out[rule.lhs / 64] |= uint64_t{1} << (rule.lhs % 64);
+                    }
+                }
+            }
+        }
+    }
+}
+
+inline bool CYKParser::recognize(const std::vector<Grammar::Symbol>& input) const {
+    const size_t n = input.size();
+    if (n == 0) {
+        return grammar_.accepts_empty;
+    }
+
+    Chart chart(n, grammar_.non_terminals.size());
+
+    for (size_t i = 0; i < n; ++i) {
+        auto it = grammar_.terminal_rules.find(input[i]);
+        if (it == grammar_.terminal_rules.end()) {
+            return false;
+        }
+
+        uint64_t* cell = chart.cell(i, i);
+        for (uint32_t a : it->second) {
+            cell[a / 64] |= uint64_t{1} << (a % 64);
+        }
+    }
+
+    const unsigned workers = n < PARALLEL_THRESHOLD
+        ? 1u
+        : static_cast<unsigned>(std::min<size_t>(threads_, n / CHUNK));
+
+    if (workers <= 1) {
+        for (size_t len = 2; len <= n; ++len) {
+            for (size_t i = 0; i + len <= n; ++i) {
+                fill_cell(chart, i, i + len - 1);
+            }
+        }
+    } else {
+        std::atomic<size_t> next{0};
+        size_t len = 2;
+
+        // runs once per diagonal after every worker arrived
+        std::barrier sync(workers, [&]() noexcept {
+            ++len;
+            next.store(0, std::memory_order_relaxed);
+        });
+
+        auto work = [&]() {
+            while (len <= n) {
+                const size_t cells = n - len + 1;
+
+                for (size_t first = next.fetch_add(CHUNK); first < cells; first = next.fetch_add(CHUNK)) {
+                    size_t last = std::min(cells, first + CHUNK);
+                    for (size_t i = first; i < last; ++i) {
+                        fill_cell(chart, i, i + len - 1);
+                    }
+                }
+
+                sync.arrive_and_wait();
+            }
+        };
+
+        std::vector<std::jthread> pool;
+        pool.reserve(workers - 1);
+        for (unsigned t = 1; t < workers; ++t) {
+            pool.emplace_back(work);
+        }
+        work();
+    }
+
+    const uint64_t* top = chart.cell(0, n - 1);
+    return top[grammar_.start / 64] >> (grammar_.start % 64) & 1;
+}
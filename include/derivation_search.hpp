@@ -0,0 +1,418 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "cnf_grammar.hpp"
+
+// Breadth-first search over leftmost derivations.
+//
+// This is what serialize_state / terminal_count / leftmost_non_terminal_pos are for,
+// without building a string per state: a sentential form is a vector of interned
+// symbol ids, its leftmost non-terminal position is kept alongside it, and it carries
+// a polynomial hash (mod 2^64, odd base) that is updated in O(|rhs|) when the leftmost
+// non-terminal is rewritten:
+//
+//   h(prefix A suffix)       = h(prefix) + B^p (A + 1) + B^(p+1) h(suffix)
+//   h(prefix rhs suffix)     = h(prefix) + B^p h(rhs) + B^(p+|rhs|) h(suffix)
+//
+// h(suffix) is recovered with the inverse of B, which exists because B is odd.
+//
+// A form is dropped as soon as it cannot lead to a short enough word: the sum of the
+// minimal yield lengths of its symbols (terminal_count for the terminals) must stay
+// within the bound, and when looking for a specific word the terminal prefix must
+// match it. Each BFS level is expanded by several threads sharing a sharded visited set.
+//
+// Nullable symbols would let forms grow without making words longer, so the search
+// runs on the grammar with ε taken out the way ChomskyNormalForm::DEL does it: every
+// rule also comes in each variant with some of its nullable symbols dropped, and the
+// empty variants are left out. The empty word is then a special case, derived exactly
+// when the start symbol is nullable. What is left yields at least one character per
+// symbol, so a form within the bound is never longer than the word it may become and
+// the search always ends.
+
+class DerivationSearch {
+public:
+    explicit DerivationSearch(
+        const Grammar& g,
+        unsigned threads = std::thread::hardware_concurrency()
+    );
+
+    // every word of at most max_length characters, shortest first then alphabetical
+    std::vector<std::string> enumerate(size_t max_length) const;
+
+    bool derives(const std::vector<Grammar::Symbol>& word) const;
+    bool derives(const std::string& word) const {
+        return derives(to_symbols(word));
+    }
+
+private:
+    static constexpr uint64_t BASE = 0x9E3779B97F4A7C15ull;
+    static constexpr uint32_t UNREACHABLE = UINT32_MAX;
+    static constexpr size_t SHARDS = 64;
+    // below this frontier size a level is expanded on the calling thread
+    static constexpr size_t PARALLEL_THRESHOLD = 512;
+
+    struct Form {
+        std::vector<uint32_t> symbols;
+        uint64_t hash;
+        // hash of the terminal prefix, i.e. of symbols[0, leftmost)
+        uint64_t prefix_hash;
+        uint32_t leftmost;
+        // sum of minimal yield lengths
+        uint32_t min_length;
+
+        bool operator==(const Form& other) const { return symbols == other.symbols; }
+    };
+
+    struct FormHash {
+        size_t operator()(const Form& f) const noexcept { return f.hash; }
+    };
+
+    class VisitedSet {
+    public:
+        bool insert(const Form& f) {
+            auto& shard = shards_[f.hash % SHARDS];
+            std::lock_guard lock(shard.mutex);
+            return shard.forms.insert(f).second;
+        }
+
+    private:
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_set<Form, FormHash> forms;
+        };
+        std::array<Shard, SHARDS> shards_;
+    };
+
+    struct Bounds {
+        size_t max_length;
+        // non-empty when only derivations of this word are wanted
+        const std::vector<uint32_t>* target;
+    };
+
+    // expands the frontier, returns the words (as symbol ids) reached on the way
+    std::vector<std::vector<uint32_t>> search(const Bounds& bounds, bool stop_at_first) const;
+    void expand(const Form& form, const Bounds& bounds, VisitedSet& visited,
+                std::vector<Form>& next, std::vector<std::vector<uint32_t>>& words) const;
+
+    uint64_t power(size_t k) const;
+    uint64_t inverse_power(size_t k) const;
+
+    std::vector<Grammar::Symbol> symbols_;
+    std::vector<bool> is_terminal_;
+    std::unordered_map<Grammar::Symbol, uint32_t> ids_;
+
+    // rules of each non-terminal without ε, with the polynomial hash of every rhs
+    struct Rule {
+        std::vector<uint32_t> rhs;
+        uint64_t hash;
+    };
+    std::vector<std::vector<Rule>> rules_;
+    std::vector<uint32_t> min_length_;
+
+    uint32_t start_;
+    bool start_nullable_ = false;
+    unsigned threads_;
+    uint64_t base_inverse_;
+};
+
+inline DerivationSearch::DerivationSearch(const Grammar& g, unsigned threads)
+    : threads_{std::max(1u, threads)} {
+    auto intern = [&](const Grammar::Symbol& s, bool terminal) {
+        ids_[s] = symbols_.size();
+        symbols_.push_back(s);
+        is_terminal_.push_back(terminal);
+    };
+
+    for (const auto& t : g.terminals) intern(t, true);
+    for (const auto& nt : g.non_terminals) intern(nt, false);
+
+    if (!ids_.contains(g.start_symbol)) {
+        intern(g.start_symbol, false);
+    }
+    start_ = ids_.at(g.start_symbol);
+
+    std::vector<std::vector<std::vector<uint32_t>>> source(symbols_.size());
+    for (const auto& [lhs, rhses] : g.productions) {
+        for (const auto& rhs : rhses) {
+            std::vector<uint32_t> ids;
+            for (const auto& sym : rhs) ids.push_back(ids_.at(sym));
+            source[ids_.at(lhs)].push_back(std::move(ids));
+        }
+    }
+
+    // minimal yield length, Bellman-Ford style until nothing improves
+    auto min_lengths = [&](const auto& rules_of, auto rhs_of) {
+        std::vector<uint32_t> length(symbols_.size(), UNREACHABLE);
+        for (uint32_t i = 0; i < symbols_.size(); ++i) {
+            if (is_terminal_[i]) length[i] = 1;
+        }
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+
+            for (uint32_t a = 0; a < symbols_.size(); ++a) {
+                for (const auto& rule : rules_of[a]) {
+                    uint64_t total = 0;
+                    for (uint32_t sym : rhs_of(rule)) total += length[sym];
+
+                    if (total < length[a]) {
+                        length[a] = total;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        return length;
+    };
+
+    // nullable is a minimal yield of 0
+    const auto source_length = min_lengths(source, [](const auto& rhs) -> const auto& { return rhs; });
+    start_nullable_ = source_length[start_] == 0;
+
+    rules_.resize(symbols_.size());
+    for (uint32_t a = 0; a < symbols_.size(); ++a) {
+        std::set<std::vector<uint32_t>> variants;
+
+        for (const auto& rhs : source[a]) {
+            // every way to drop nullable symbols, as ChomskyNormalForm::DEL
+            std::vector<std::vector<uint32_t>> options = { {} };
+            for (uint32_t sym : rhs) {
+                const size_t old_size = options.size();
+                if (source_length[sym] == 0) {
+                    // copies that leave sym out, indices since push_back may reallocate
+                    for (size_t i = 0; i < old_size; ++i) options.push_back(options[i]);
+                }
+                for (size_t i = 0; i < old_size; ++i) {
+                    options[i].push_back(sym);
+                }
+            }
+
+            for (auto& option : options) {
+                if (!option.empty()) variants.insert(std::move(option));
+            }
+        }
+
+        for (const auto& rhs : variants) {
+            Rule rule{ rhs, 0 };
+            uint64_t p = 1;
+
+            for (uint32_t id : rhs) {
+                rule.hash += p * (id + 1);
+                p *= BASE;
+            }
+
+            rules_[a].push_back(std::move(rule));
+        }
+    }
+
+    // Newton iteration for the inverse of an odd number mod 2^64
+    base_inverse_ = BASE;
+    for (int i = 0; i < 6; ++i) {
+        base_inverse_ *= 2 - BASE * base_inverse_;
+    }
+
+    min_length_ = min_lengths(rules_, [](const Rule& rule) -> const auto& { return rule.rhs; });
+}
+
+inline uint64_t DerivationSearch::power(size_t k) const {
+    uint64_t result = 1, b = BASE;
+    for (; k; k >>= 1, b *= b) {
+        if (k & 1) result *= b;
+    }
+    return result;
+}
+
+inline uint64_t DerivationSearch::inverse_power(size_t k) const {
+    uint64_t result = 1, b = base_inverse_;
+    for (; k; k >>= 1, b *= b) {
+        if (k & 1) result *= b;
+    }
+    return result;
+}
+
+inline void DerivationSearch::expand(
+    const Form& form,
+    const Bounds& bounds,
+    VisitedSet& visited,
+    std::vector<Form>& next,
+    std::vector<std::vector<uint32_t>>& words
+) const {
+    const uint32_t p = form.leftmost;
+    const uint32_t a = form.symbols[p];
+    const uint64_t bp = power(p);
+    const uint64_t suffix_hash = (form.hash - form.prefix_hash - bp * (a + 1)) * inverse_power(p + 1);
+
+    for (const auto& rule : rules_[a]) {
+        const uint64_t min_length = uint64_t{form.min_length} - min_length_[a] + [&] {
+            uint64_t total = 0;
+            for (uint32_t sym : rule.rhs) total += min_length_[sym];
+            return total;
+        }();
+
+        // every symbol yields a character at least, so this bounds the form length too
+        if (min_length > bounds.max_length) {
+            continue;
+        }
+
+        const size_t length = form.symbols.size() - 1 + rule.rhs.size();
+
+        Form child;
+        child.symbols.reserve(length);
+        child.symbols.insert(child.symbols.end(), form.symbols.begin(), form.symbols.begin() + p);
+        child.symbols.insert(child.symbols.end(), rule.rhs.begin(), rule.rhs.end());
+        child.symbols.insert(child.symbols.end(), form.symbols.begin() + p + 1, form.symbols.end());
+        child.min_length = static_cast<uint32_t>(min_length);
+        child.hash = form.prefix_hash + bp * rule.hash + power(p + rule.rhs.size()) * suffix_hash;
+
+        // move the leftmost marker past the terminals that just got exposed
+        child.leftmost = p;
+        child.prefix_hash = form.prefix_hash;
+        uint64_t pw = bp;
+        bool prefix_ok = true;
+
+        while (child.leftmost < child.symbols.size() && is_terminal_[child.symbols[child.leftmost]]) {
+            const uint32_t sym = child.symbols[child.leftmost];
+
+            if (bounds.target) {
+                const auto& target = *bounds.target;
+                if (child.leftmost >= target.size() || target[child.leftmost] != sym) {
+                    prefix_ok = false;
+                    break;
+                }
+            }
+
+            child.prefix_hash += pw * (sym + 1);
+            pw *= BASE;
+            child.leftmost++;
+        }
+
+        if (!prefix_ok) {
+            continue;
+        }
+
+        if (!visited.insert(child)) {
+            continue;
+        }
+
+        if (child.leftmost == child.symbols.size()) {
+            if (!bounds.target || child.symbols.size() == bounds.target->size()) {
+                words.push_back(std::move(child.symbols));
+            }
+        } else {
+            next.push_back(std::move(child));
+        }
+    }
+}
+
+inline std::vector<std::vector<uint32_t>> DerivationSearch::search(const Bounds& bounds, bool stop_at_first) const {
+    std::vector<std::vector<uint32_t>> words;
+
+    if (min_length_[start_] > bounds.max_length) {
+        return words;
+    }
+
+    VisitedSet visited;
+    std::vector<Form> frontier;
+    {
+        Form root{ { start_ }, start_ + 1, 0, 0, min_length_[start_] };
+        visited.insert(root);
+        frontier.push_back(std::move(root));
+    }
+
+    std::atomic<bool> found{false};
+
+    while (!frontier.empty() && !(stop_at_first && found)) {
+        const unsigned workers = frontier.size() < PARALLEL_THRESHOLD
+            ? 1u
+            : std::min<unsigned>(threads_, frontier.size() / 64);
+
+        std::vector<std::vector<Form>> next(workers);
+        std::vector<std::vector<std::vector<uint32_t>>> local_words(workers);
+        std::atomic<size_t> cursor{0};
+
+        auto work = [&](unsigned w) {
+            constexpr size_t CHUNK = 32;
+            for (size_t first = cursor.fetch_add(CHUNK); first < frontier.size(); first = cursor.fetch_add(CHUNK)) {
+                if (stop_at_first && found.load(std::memory_order_relaxed)) return;
+
+                const size_t last = std::min(frontier.size(), first + CHUNK);
+                for (size_t i = first; i < last; ++i) {
+                    expand(frontier[i], bounds, visited, next[w], local_words[w]);
+                }
+
+                if (!local_words[w].empty()) {
+                    found.store(true, std::memory_order_relaxed);
+                }
+            }
+        };
+
+        if (workers == 1) {
+            work(0);
+        } else {
+            std::vector<std::jthread> pool;
+            for (unsigned w = 1; w < workers; ++w) {
+                pool.emplace_back(work, w);
+            }
+            work(0);
+        }
+
+        frontier.clear();
+        for (unsigned w = 0; w < workers; ++w) {
+            for (auto& f : next[w]) frontier.push_back(std::move(f));
+            for (auto& word : local_words[w]) words.push_back(std::move(word));
+        }
+    }
+
+    return words;
+}
+
+inline std::vector<std::string> DerivationSearch::enumerate(size_t max_length) const {
+    Bounds bounds{ max_length, nullptr };
+
+    std::vector<std::string> out;
+    if (start_nullable_) {
+        out.push_back("");
+    }
+    for (const auto& word : search(bounds, false)) {
+        std::string s;
+        for (uint32_t sym : word) s += symbols_[sym];
+        out.push_back(std::move(s));
+    }
+
+    std::ranges::sort(out, [](const std::string& a, const std::string& b) {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+    auto [first, last] = std::ranges::unique(out);
+    out.erase(first, last);
+    return out;
+}
+
+inline bool DerivationSearch::derives(const std::vector<Grammar::Symbol>& word) const {
+    if (word.empty()) {
+        return start_nullable_;
+    }
+
+    std::vector<uint32_t> target;
+    for (const auto& sym : word) {
+        auto it = ids_.find(sym);
+        if (it == ids_.end() || !is_terminal_[it->second]) {
+            return false;
+        }
+        target.push_back(it->second);
+    }
+
+    Bounds bounds{ word.size(), &target };
+    return !search(bounds, true).empty();
+}
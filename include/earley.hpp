@@ -0,0 +1,510 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "cnf_grammar.hpp"
+
+// Earley parser working directly on a Grammar, no CNF conversion needed.
+//
+// Every production gets a contiguous block of dotted rule ids (one per dot position),
+// so an item is just (dotted rule id, origin). Nullable non-terminals are handled the
+// Aycock-Horspool way: predicting a nullable B also moves the dot over B right away,
+// which makes epsilon rules like C -> ε work without re-running completions.
+//
+// recognize() also uses Leo's deterministic reductions. When set i has exactly one item
+// waiting on B and it is A -> α . B, completing B from i can only complete that item,
+// and then whatever waits on A at its origin, and so on up the chain. Only the topmost
+// item of such a chain goes into the set, found through a per-set memo, which keeps
+// right recursion linear instead of quadratic. parse() needs every completed item for
+// the forest, so it runs without them.
+//
+// Each item remembers the split points it was reached from. That is enough to build a
+// shared packed parse forest afterwards: symbol nodes (X, i, j), intermediate nodes for
+// partially recognized rules (A -> α . β, i, j) and packed nodes for the alternatives.
+
+struct SPPFPacked {
+    size_t rule;
+    // node ids, -1 when there is no child on that side
+    int left = -1;
+    int right = -1;
+};
+
+struct SPPFNode {
+    enum class Kind { Symbol, Intermediate };
+
+    Kind kind;
+    std::string label;
+    size_t start;
+    size_t end;
+    std::vector<SPPFPacked> packed;
+};
+
+struct SharedPackedForest {
+    std::vector<SPPFNode> nodes;
+    int root = -1;
+
+    bool is_ambiguous() const {
+        for (const auto& node : nodes) {
+            if (node.packed.size() > 1) return true;
+        }
+        return false;
+    }
+
+    void print(std::ostream& os = std::cout) const {
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const auto& node = nodes[i];
+            os << i << ": (" << node.label << ", " << node.start << ", " << node.end << ")";
+
+            for (const auto& p : node.packed) {
+                os << " [";
+                if (p.left != -1) os << p.left << ' ';
+                os << (p.right == -1 ? "ε" : std::to_string(p.right)) << ']';
+            }
+            os << '\n';
+        }
+    }
+};
+
+class EarleyParser {
+public:
+    explicit EarleyParser(const Grammar& g);
+
+    bool recognize(const std::vector<Grammar::Symbol>& input) const;
+    bool recognize(const std::string& input) const {
+        return recognize(to_symbols(input));
+    }
+
+    std::optional<SharedPackedForest> parse(const std::vector<Grammar::Symbol>& input) const;
+    std::optional<SharedPackedForest> parse(const std::string& input) const {
+        return parse(to_symbols(input));
+    }
+
+    // "A -> B c" for the production behind SPPFPacked::rule
+    std::string rule_to_string(size_t rule) const;
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Item {
+        uint32_t dotted;
+        uint32_t origin;
+        // sets where the symbol before the dot started
+        std::vector<uint32_t> splits;
+    };
+
+    struct EarleySet {
+        std::vector<Item> items;
+        std::unordered_map<uint64_t, uint32_t> index;
+        // (lhs, origin) pairs completed here; the waiting items only depend on those
+        std::unordered_set<uint64_t> completed;
+        // items that have this set itself as a split, the one split that can come twice
+        std::unordered_set<uint32_t> split_here;
+        // symbol -> items of this set with the dot in front of it
+        std::unordered_map<uint32_t, std::vector<uint32_t>> waiting;
+        // symbol -> topmost item of its deterministic reduction path, as (dotted, origin)
+        std::unordered_map<uint32_t, uint64_t> leo;
+    };
+
+    using Chart = std::vector<EarleySet>;
+
+    static constexpr uint64_t NO_LEO = UINT64_MAX;
+
+    bool run(const std::vector<Grammar::Symbol>& input, Chart& chart, bool leo) const;
+    uint64_t leo_item(Chart& chart, uint32_t set, uint32_t symbol) const;
+    void add_item(Chart& chart, size_t set, uint32_t dotted, uint32_t origin, uint32_t split) const;
+    const Item* find_item(const Chart& chart, size_t set, uint32_t dotted, uint32_t origin) const;
+    bool accepted(const Chart& chart) const;
+
+    uint32_t symbol_id(const Grammar::Symbol& s) const {
+        auto it = ids_.find(s);
+        return it == ids_.end() ? NONE : it->second;
+    }
+
+    uint32_t next_symbol(uint32_t dotted) const {
+        uint32_t rule = dotted_rule_[dotted];
+        uint32_t dot = dotted - rule_offset_[rule];
+        return dot < rhs_[rule].size() ? rhs_[rule][dot] : NONE;
+    }
+
+    std::vector<Grammar::Symbol> symbols_;
+    std::vector<bool> is_terminal_;
+    std::unordered_map<Grammar::Symbol, uint32_t> ids_;
+
+    std::vector<uint32_t> lhs_;
+    std::vector<std::vector<uint32_t>> rhs_;
+    std::vector<std::vector<uint32_t>> rules_by_lhs_;
+    std::vector<bool> nullable_;
+
+    // dotted rule d belongs to rule dotted_rule_[d], dot = d - rule_offset_[rule]
+    std::vector<uint32_t> rule_offset_;
+    std::vector<uint32_t> dotted_rule_;
+
+    uint32_t start_;
+};
+
+inline EarleyParser::EarleyParser(const Grammar& g) {
+    auto intern = [&](const Grammar::Symbol& s, bool terminal) {
+        ids_[s] = symbols_.size();
+        symbols_.push_back(s);
+        is_terminal_.push_back(terminal);
+    };
+
+    for (const auto& t : g.terminals) intern(t, true);
+    for (const auto& nt : g.non_terminals) intern(nt, false);
+
+    if (!g.non_terminals.contains(g.start_symbol)) {
+        throw std::runtime_error("Start symbol " + g.start_symbol + " is not a non-terminal");
+    }
+    start_ = ids_.at(g.start_symbol);
+
+    rules_by_lhs_.resize(symbols_.size());
+
+    // sorted so rule ids do not depend on the hash map order
+    std::vector<Grammar::LHS> lhs_list;
+    for (const auto& [lhs, _] : g.productions) lhs_list.push_back(lhs);
+    std::ranges::sort(lhs_list);
+
+    for (const auto& lhs : lhs_list) {
+        uint32_t a = symbol_id(lhs);
+        if (a == NONE || is_terminal_[a]) {
+            throw std::runtime_error("Production for unknown non-terminal " + lhs);
+        }
+
+        for (const auto& rhs : g.productions.at(lhs)) {
+            std::vector<uint32_t> ids;
+            for (const auto& sym : rhs) {
+                uint32_t id = symbol_id(sym);
+                if (id == NONE) {
+                    throw std::runtime_error("Unknown symbol " + sym + " in production of " + lhs);
+                }
+                ids.push_back(id);
+            }
+
+            uint32_t rule = lhs_.size();
+            rules_by_lhs_[a].push_back(rule);
+            lhs_.push_back(a);
+            rule_offset_.push_back(dotted_rule_.size());
+            dotted_rule_.insert(dotted_rule_.end(), ids.size() + 1, rule);
+            rhs_.push_back(std::move(ids));
+        }
+    }
+
+    // same counting fixpoint as ChomskyNormalForm::DEL
+    nullable_.assign(symbols_.size(), false);
+    std::vector<uint32_t> need(lhs_.size());
+    std::vector<std::vector<uint32_t>> uses(symbols_.size());
+    std::vector<uint32_t> worklist;
+
+    for (uint32_t r = 0; r < lhs_.size(); ++r) {
+        for (uint32_t sym : rhs_[r]) {
+            uses[sym].push_back(r);
+        }
+        need[r] = rhs_[r].size();
+
+        if (need[r] == 0 && !nullable_[lhs_[r]]) {
+            nullable_[lhs_[r]] = true;
+            worklist.push_back(lhs_[r]);
+        }
+    }
+
+    while (!worklist.empty()) {
+        uint32_t sym = worklist.back();
+        worklist.pop_back();
+
+        for (uint32_t r : uses[sym]) {
+            if (--need[r] == 0 && !nullable_[lhs_[r]]) {
+                nullable_[lhs_[r]] = true;
+                worklist.push_back(lhs_[r]);
+            }
+        }
+    }
+}
+
+inline void EarleyParser::add_item(
+    Chart& chart,
+    size_t set,
+    uint32_t dotted,
+    uint32_t origin,
+    uint32_t split
+) const {
+    auto& es = chart[set];
+    uint64_t key = uint64_t{dotted} << 32 | origin;
+
+    auto [it, inserted] = es.index.try_emplace(key, es.items.size());
+    if (inserted) {
+        es.items.push_back({ dotted, origin, {} });
+
+        uint32_t next = next_symbol(dotted);
+        if (next != NONE) {
+            es.waiting[next].push_back(it->second);
+        }
+    }
+
+    if (split != NONE) {
+        // every other split comes from one scan or one completion of (lhs, origin), but
+        // split == set also comes from the nullable shortcut in predict
+        if (split != set || es.split_here.insert(it->second).second) {
+            es.items[it->second].splits.push_back(split);
+        }
+    }
+}
+
+inline const EarleyParser::Item* EarleyParser::find_item(
+    const Chart& chart,
+    size_t set,
+    uint32_t dotted,
+    uint32_t origin
+) const {
+    const auto& es = chart[set];
+    auto it = es.index.find(uint64_t{dotted} << 32 | origin);
+    return it == es.index.end() ? nullptr : &es.items[it->second];
+}
+
+inline uint64_t EarleyParser::leo_item(Chart& chart, uint32_t set, uint32_t symbol) const {
+    // NO_LEO goes in first, so a cycle of unit rules stops where it comes back
+    auto [memo, inserted] = chart[set].leo.try_emplace(symbol, NO_LEO);
+    if (!inserted) {
+        return memo->second;
+    }
+
+    auto wit = chart[set].waiting.find(symbol);
+    if (wit == chart[set].waiting.end() || wit->second.size() != 1) {
+        return NO_LEO;
+    }
+
+    const Item& parent = chart[set].items[wit->second.front()];
+    const uint32_t done = parent.dotted + 1;
+    if (next_symbol(done) != NONE) {
+        return NO_LEO;
+    }
+
+    const uint32_t origin = parent.origin;
+    const uint32_t lhs = lhs_[dotted_rule_[done]];
+    uint64_t top = uint64_t{done} << 32 | origin;
+
+    // a completed start rule from 0 is what accepted() looks for, so it stays
+    if (lhs != start_ || origin != 0) {
+        const uint64_t above = leo_item(chart, origin, lhs);
+        if (above != NO_LEO) {
+            top = above;
+        }
+    }
+
+    // the recursion may have rehashed the memo
+    chart[set].leo[symbol] = top;
+    return top;
+}
+
+inline bool EarleyParser::run(const std::vector<Grammar::Symbol>& input, Chart& chart, bool leo) const {
+    const size_t n = input.size();
+    chart.assign(n + 1, {});
+
+    for (uint32_t rule : rules_by_lhs_[start_]) {
+        add_item(chart, 0, rule_offset_[rule], 0, NONE);
+    }
+
+    for (size_t j = 0; j <= n; ++j) {
+        uint32_t token = NONE;
+        if (j < n) {
+            token = symbol_id(input[j]);
+            if (token == NONE || !is_terminal_[token]) {
+                return false;
+            }
+        }
+
+        // items are appended while we walk the set, so no references or iterators here
+        for (size_t idx = 0; idx < chart[j].items.size(); ++idx) {
+            const uint32_t dotted = chart[j].items[idx].dotted;
+            const uint32_t origin = chart[j].items[idx].origin;
+            const uint32_t next = next_symbol(dotted);
+
+            if (next == NONE) {
+                // complete
+                const uint32_t lhs = lhs_[dotted_rule_[dotted]];
+
+                // set origin is still growing when it is this one
+                if (leo && origin < j) {
+                    const uint64_t top = leo_item(chart, origin, lhs);
+                    if (top != NO_LEO) {
+                        add_item(chart, j, top >> 32, static_cast<uint32_t>(top), NONE);
+                        continue;
+                    }
+                }
+
+                // another production of lhs from the same origin advances the same items
+                if (!chart[j].completed.insert(uint64_t{lhs} << 32 | origin).second) continue;
+
+                auto wit = chart[origin].waiting.find(lhs);
+                if (wit == chart[origin].waiting.end()) continue;
+
+                for (size_t w = 0; w < wit->second.size(); ++w) {
+                    const Item& parent = chart[origin].items[wit->second[w]];
+                    add_item(chart, j, parent.dotted + 1, parent.origin, origin);
+                    // add_item may rehash the waiting map of this very set
+                    wit = chart[origin].waiting.find(lhs);
+                }
+            } else if (is_terminal_[next]) {
+                // scan
+                if (next == token) {
+                    add_item(chart, j + 1, dotted + 1, origin, j);
+                }
+            } else {
+                // predict
+                for (uint32_t rule : rules_by_lhs_[next]) {
+                    add_item(chart, j, rule_offset_[rule], j, NONE);
+                }
+
+                if (nullable_[next]) {
+                    add_item(chart, j, dotted + 1, origin, j);
+                }
+            }
+        }
+
+        if (j < n && chart[j + 1].items.empty()) {
+            return false;
+        }
+    }
+
+    return accepted(chart);
+}
+
+inline bool EarleyParser::accepted(const Chart& chart) const {
+    const size_t n = chart.size() - 1;
+
+    for (uint32_t rule : rules_by_lhs_[start_]) {
+        uint32_t done = rule_offset_[rule] + rhs_[rule].size();
+        if (find_item(chart, n, done, 0)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+inline bool EarleyParser::recognize(const std::vector<Grammar::Symbol>& input) const {
+    Chart chart;
+    return run(input, chart, true);
+}
+
+inline std::string EarleyParser::rule_to_string(size_t rule) const {
+    std::string out = symbols_[lhs_[rule]] + " ->";
+    if (rhs_[rule].empty()) {
+        out += " ε";
+    }
+    for (uint32_t sym : rhs_[rule]) {
+        out += ' ';
+        out += symbols_[sym];
+    }
+    return out;
+}
+
+inline std::optional<SharedPackedForest> EarleyParser::parse(const std::vector<Grammar::Symbol>& input) const {
+    Chart chart;
+    if (!run(input, chart, false)) {
+        return std::nullopt;
+    }
+
+    SharedPackedForest forest;
+
+    // (kind, label id, start, end) -> node id
+    struct Key {
+        bool symbol;
+        uint32_t label;
+        uint32_t start;
+        uint32_t end;
+        bool operator==(const Key&) const = default;
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const noexcept {
+            uint64_t h = (uint64_t{k.label} << 1 | k.symbol) * 0x9E3779B97F4A7C15ull;
+            h ^= (uint64_t{k.start} << 32 | k.end) + 0x7F4A7C159E3779B9ull + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    std::unordered_map<Key, int, KeyHash> node_ids;
+    // nodes whose packed children are not built yet; a queue instead of recursion
+    // keeps long inputs from running out of stack
+    std::deque<Key> pending;
+
+    auto node_for = [&](bool symbol, uint32_t label, uint32_t start, uint32_t end) {
+        Key key{ symbol, label, start, end };
+        auto [it, inserted] = node_ids.try_emplace(key, forest.nodes.size());
+
+        if (inserted) {
+            std::string text;
+            if (symbol) {
+                text = symbols_[label];
+            } else {
+                uint32_t rule = dotted_rule_[label];
+                uint32_t dot = label - rule_offset_[rule];
+                text = symbols_[lhs_[rule]] + " ->";
+                for (uint32_t i = 0; i <= rhs_[rule].size(); ++i) {
+                    if (i == dot) text += " .";
+                    if (i < rhs_[rule].size()) text += " " + symbols_[rhs_[rule][i]];
+                }
+            }
+
+            forest.nodes.push_back({
+                symbol ? SPPFNode::Kind::Symbol : SPPFNode::Kind::Intermediate,
+                std::move(text),
+                start,
+                end,
+                {}
+            });
+
+            if (!symbol || !is_terminal_[label]) {
+                pending.push_back(key);
+            }
+        }
+
+        return it->second;
+    };
+
+    // packed children of the item (dotted, origin) in set `end`, dot > 0
+    auto add_alternatives = [&](int node, uint32_t dotted, uint32_t origin, uint32_t end) {
+        const Item* item = find_item(chart, end, dotted, origin);
+        const uint32_t rule = dotted_rule_[dotted];
+        const uint32_t dot = dotted - rule_offset_[rule];
+        const uint32_t sym = rhs_[rule][dot - 1];
+
+        for (uint32_t split : item->splits) {
+            int right = node_for(true, sym, split, end);
+            int left = dot == 1 ? -1 : node_for(false, dotted - 1, origin, split);
+            forest.nodes[node].packed.push_back({ rule, left, right });
+        }
+    };
+
+    forest.root = node_for(true, start_, 0, input.size());
+
+    while (!pending.empty()) {
+        Key key = pending.front();
+        pending.pop_front();
+        const int node = node_ids.at(key);
+
+        if (!key.symbol) {
+            add_alternatives(node, key.label, key.start, key.end);
+            continue;
+        }
+
+        for (uint32_t rule : rules_by_lhs_[key.label]) {
+            uint32_t done = rule_offset_[rule] + rhs_[rule].size();
+            if (!find_item(chart, key.end, done, key.start)) continue;
+
+            if (rhs_[rule].empty()) {
+                forest.nodes[node].packed.push_back({ rule, -1, -1 });
+            } else {
+                add_alternatives(node, done, key.start, key.end);
+            }
+        }
+    }
+
+    return forest;
+}
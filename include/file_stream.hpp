@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <string>
+
+// A file read front to back in chunks with read(), for what cannot be mapped: pipes,
+// FIFOs, /dev/stdin. The descriptor lives as long as the object.
+class FileStream {
+public:
+    static constexpr size_t CHUNK = size_t{1} << 16;
+
+    explicit FileStream(const std::string& path);
+    ~FileStream();
+
+    FileStream(const FileStream&) = delete;
+    FileStream& operator=(const FileStream&) = delete;
+
+    // appends up to CHUNK bytes to out; 0 once the file is used up
+    size_t read(std::string& out);
+
+private:
+    int fd_ = -1;
+    std::string path_;
+};
+
+inline FileStream::FileStream(const std::string& path)
+    : fd_{::open(path.c_str(), O_RDONLY)},
+      path_{path} {
+    if (fd_ == -1) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+}
+
+inline FileStream::~FileStream() {
+    ::close(fd_);
+}
+
+inline size_t FileStream::read(std::string& out) {
+    const size_t old = out.size();
+    out.resize(old + CHUNK);
+
+    ssize_t got;
+    do {
+        got = ::read(fd_, out.data() + old, CHUNK);
+    } while (got == -1 && errno == EINTR);
+
+    if (got == -1) {
+        out.resize(old);
+        throw std::runtime_error("Could not read file: " + path_);
+    }
+
+    out.resize(old + got);
+    return got;
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "finite_automaton.hpp"
+#include "regex_positions.hpp"
+
+// ε-free Glushkov NFA of a RegexAST.
+//
+// State 0 is the initial state and state p + 1 stands for position p; every transition
+// into p + 1 reads the character of position p, so a state set together with the next
+// character fully determines the successor set:
+//
+//   next = follow(current) & positions_of(c)
+//
+// matches() runs exactly that on bitsets. follow(current) is looked up a byte at a
+// time: for every 8-state chunk of the set there is a 256-entry table holding the union
+// of the follow sets of any combination of those 8 states. Past MAX_TABLE_WORDS the
+// tables would get too big and the follow sets of the set bits are or-ed one by one.
+
+class GlushkovNFA {
+public:
+    explicit GlushkovNFA(const RegexAST& ast);
+
+    size_t state_count() const { return states_; }
+    // heap memory held, roughly
+    size_t byte_size() const;
+
+    bool matches(std::string_view input) const;
+
+    // the same automaton with string states q0, q1, ..., for validate_string and convert_to_dfa
+    FiniteAutomaton to_finite_automaton() const;
+
+private:
+    static constexpr size_t MAX_TABLE_WORDS = size_t{1} << 22;
+
+    const uint64_t* follow_bits(size_t state) const { return &follow_[state * words_]; }
+
+    RegexPositions positions_;
+    size_t states_;
+    size_t words_;
+
+    // per state, the bitset of its successors
+    std::vector<uint64_t> follow_;
+    // per byte value, the bitset of states entered by reading it
+    std::vector<uint64_t> char_mask_;
+    std::vector<uint64_t> final_;
+
+    // [chunk][byte value] -> union of follow sets, empty when not built
+    std::vector<uint64_t> table_;
+};
+
+inline GlushkovNFA::GlushkovNFA(const RegexAST& ast)
+    : positions_{ast},
+      states_{positions_.size() + 1},
+      words_{(states_ + 63) / 64},
+      follow_(states_ * words_, 0),
+      char_mask_(256 * words_, 0),
+      final_(words_, 0) {
+    auto set = [](uint64_t* bits, size_t i) { bits[i / 64] |= uint64_t{1} << (i % 64); };
+
+    for (uint32_t p : positions_.first) {
+        set(&follow_[0], p + 1);
+    }
+
+    for (size_t p = 0; p < positions_.size(); ++p) {
+        for (uint32_t q : positions_.follow[p]) {
+            set(&follow_[(p + 1) * words_], q + 1);
+        }
+
+        set(&char_mask_[static_cast<unsigned char>(positions_.symbol[p]) * words_], p + 1);
+
+        if (positions_.last[p]) {
+            set(final_.data(), p + 1);
+        }
+    }
+
+    if (positions_.nullable) {
+        set(final_.data(), 0);
+    }
+
+    const size_t chunks = (states_ + 7) / 8;
+    if (chunks * 256 * words_ > MAX_TABLE_WORDS) {
+        return;
+    }
+
+    table_.assign(chunks * 256 * words_, 0);
+    for (size_t k = 0; k < chunks; ++k) {
+        uint64_t* chunk = &table_[k * 256 * words_];
+
+        // every entry is a smaller entry plus the follow set of its lowest state
+        for (unsigned v = 1; v < 256; ++v) {
+            const size_t state = k * 8 + std::countr_zero(v);
+            if (state >= states_) continue;
+
+            const uint64_t* rest = &chunk[(v & (v - 1)) * words_];
+            const uint64_t* own = follow_bits(state);
+            for (size_t w = 0; w < words_; ++w) {
+                chunk[v * words_ + w] = rest[w] | own[w];
+            }
+        }
+    }
+}
+
+inline size_t GlushkovNFA::byte_size() const {
+    size_t bytes = (follow_.size() + char_mask_.size() + final_.size() + table_.size()) * sizeof(uint64_t);
+    for (const auto& follow : positions_.follow) {
+        bytes += follow.size() * sizeof(uint32_t);
+    }
+    return bytes + positions_.size();
+}
+
+inline bool GlushkovNFA::matches(std::string_view input) const {
+    std::vector<uint64_t> current(words_, 0);
+    std::vector<uint64_t> next(words_);
+    current[0] = 1;
+
+    for (char c : input) {
+        std::fill(next.begin(), next.end(), 0);
+
+        if (!table_.empty()) {
+            for (size_t w = 0; w < words_; ++w) {
+                for (uint64_t bits = current[w]; bits != 0; ) {
+                    // a whole byte at once, the table covers all 8 states of it
+                    const unsigned shift = std::countr_zero(bits) & ~7u;
+                    const unsigned byte = (bits >> shift) & 0xff;
+                    const size_t chunk = w * 8 + shift / 8;
+
+                    const uint64_t* entry = &table_[(chunk * 256 + byte) * words_];
+                    for (size_t x = 0; x < words_; ++x) next[x] |= entry[x];
+
+                    bits &= ~(uint64_t{0xff} << shift);
+                }
+            }
+        } else {
+            for (size_t w = 0; w < words_; ++w) {
+                for (uint64_t bits = current[w]; bits != 0; bits &= bits - 1) {
+                    const uint64_t* own = follow_bits(w * 64 + std::countr_zero(bits));
+                    for (size_t x = 0; x < words_; ++x) next[x] |= own[x];
+                }
+            }
+        }
+
+        const uint64_t* mask = &char_mask_[static_cast<unsigned char>(c) * words_];
+        uint64_t any = 0;
+        for (size_t x = 0; x < words_; ++x) {
+            next[x] &= mask[x];
+            any |= next[x];
+        }
+
+        if (any == 0) {
+            return false;
+        }
+        current.swap(next);
+    }
+
+    for (size_t x = 0; x < words_; ++x) {
+        if (current[x] & final_[x]) return true;
+    }
+    return false;
+}
+
+inline FiniteAutomaton GlushkovNFA::to_finite_automaton() const {
+    auto name = [](size_t state) { return "q" + std::to_string(state); };
+
+    States states;
+    Alphabet alphabet;
+    FinalStates finals;
+    Transitions transitions;
+
+    for (size_t s = 0; s < states_; ++s) {
+        states.insert(name(s));
+
+        const uint64_t* bits = follow_bits(s);
+        for (size_t t = 1; t < states_; ++t) {
+            if ((bits[t / 64] >> (t % 64)) & 1) {
+                const char c = positions_.symbol[t - 1];
+                transitions[{ name(s), c }].insert(name(t));
+            }
+        }
+
+        if ((final_[s / 64] >> (s % 64)) & 1) {
+            finals.insert(name(s));
+        }
+    }
+
+    for (char c : positions_.symbol) {
+        alphabet.insert(c);
+    }
+
+    return FiniteAutomaton(states, alphabet, name(0), finals, transitions);
+}
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cnf_grammar.hpp"
+
+// Bitset over terminal ids, the end marker included.
+class TerminalSet {
+public:
+    explicit TerminalSet(size_t size = 0)
+        : words_((size + 63) / 64, 0) {};
+
+    bool contains(uint32_t t) const {
+        return (words_[t / 64] >> (t % 64)) & 1;
+    }
+
+    // all of these report whether the set grew
+    bool insert(uint32_t t) {
+        const uint64_t bit = uint64_t{1} << (t % 64);
+        if (words_[t / 64] & bit) return false;
+        words_[t / 64] |= bit;
+        return true;
+    }
+
+    bool merge(const TerminalSet& other) {
+        uint64_t grew = 0;
+        for (size_t i = 0; i < words_.size(); ++i) {
+            grew |= other.words_[i] & ~words_[i];
+            words_[i] |= other.words_[i];
+        }
+        return grew != 0;
+    }
+
+    bool intersects(const TerminalSet& other) const {
+        for (size_t i = 0; i < words_.size(); ++i) {
+            if (words_[i] & other.words_[i]) return true;
+        }
+        return false;
+    }
+
+    template<typename F>
+    void for_each(F f) const {
+        for (size_t i = 0; i < words_.size(); ++i) {
+            for (uint64_t w = words_[i]; w != 0; w &= w - 1) {
+                f(static_cast<uint32_t>(i * 64 + std::countr_zero(w)));
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> words_;
+};
+
+// Interned view of a Grammar with the usual parser-generator sets.
+//
+// Terminals get ids [0, T), the end marker "$" is T, and non-terminals follow it, so
+// "is a terminal" is a single comparison and terminal sets are indexed directly by id.
+// Productions are numbered in sorted lhs order, keeping the numbering independent of
+// the unordered_map.
+//
+// NULLABLE is the counting fixpoint ChomskyNormalForm::DEL uses. FIRST and FOLLOW are
+// worklist fixpoints over the "flows into" edges between non-terminals: a set is only
+// revisited after one of the sets it depends on actually grew.
+
+class GrammarAnalysis {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Production {
+        uint32_t lhs;
+        std::vector<uint32_t> rhs;
+    };
+
+    explicit GrammarAnalysis(const Grammar& g);
+
+    uint32_t end_marker() const { return end_; }
+    size_t symbol_count() const { return names_.size(); }
+    size_t non_terminal_count() const { return names_.size() - end_ - 1; }
+
+    bool is_terminal(uint32_t id) const { return id <= end_; }
+    // index of a non-terminal among the non-terminals, for dense per-non-terminal tables
+    uint32_t non_terminal_index(uint32_t id) const { return id - end_ - 1; }
+
+    uint32_t id_of(const Grammar::Symbol& sym) const {
+        auto it = ids_.find(sym);
+        return it == ids_.end() ? NONE : it->second;
+    }
+    const Grammar::Symbol& name(uint32_t id) const { return names_[id]; }
+
+    uint32_t start() const { return start_; }
+
+    const std::vector<Production>& productions() const { return productions_; }
+    const std::vector<uint32_t>& productions_of(uint32_t nt) const { return by_lhs_[nt]; }
+
+    bool nullable(uint32_t id) const { return nullable_[id]; }
+    const TerminalSet& first(uint32_t id) const { return first_[id]; }
+    const TerminalSet& follow(uint32_t nt) const { return follow_[nt]; }
+
+    // adds FIRST of the symbol string [begin, end) to out, returns whether the string is nullable
+    bool first_of(const uint32_t* begin, const uint32_t* end, TerminalSet& out) const;
+
+    std::string production_to_string(size_t p) const;
+
+private:
+    void compute_nullable();
+    void compute_first();
+    void compute_follow();
+
+    uint32_t end_ = 0;
+    uint32_t start_ = 0;
+
+    std::vector<Grammar::Symbol> names_;
+    std::unordered_map<Grammar::Symbol, uint32_t> ids_;
+
+    std::vector<Production> productions_;
+    std::vector<std::vector<uint32_t>> by_lhs_;
+
+    std::vector<bool> nullable_;
+    std::vector<TerminalSet> first_;
+    std::vector<TerminalSet> follow_;
+};
+
+inline GrammarAnalysis::GrammarAnalysis(const Grammar& g) {
+    auto intern = [&](const Grammar::Symbol& sym) {
+        if (!ids_.emplace(sym, names_.size()).second) {
+            throw std::runtime_error("Symbol " + sym + " is both a terminal and a non-terminal");
+        }
+        names_.push_back(sym);
+    };
+
+    for (const auto& t : g.terminals) intern(t);
+    end_ = names_.size();
+    names_.push_back("$");
+    for (const auto& nt : g.non_terminals) intern(nt);
+
+    start_ = id_of(g.start_symbol);
+    if (start_ == NONE || is_terminal(start_)) {
+        throw std::runtime_error("Start symbol " + g.start_symbol + " is not a non-terminal");
+    }
+
+    by_lhs_.resize(names_.size());
+
+    std::vector<Grammar::LHS> lhs_list;
+    for (const auto& [lhs, _] : g.productions) lhs_list.push_back(lhs);
+    std::ranges::sort(lhs_list);
+
+    for (const auto& lhs : lhs_list) {
+        const uint32_t a = id_of(lhs);
+        if (a == NONE || is_terminal(a)) {
+            throw std::runtime_error("Production for unknown non-terminal " + lhs);
+        }
+
+        for (const auto& rhs : g.productions.at(lhs)) {
+            Production p{ a, {} };
+            for (const auto& sym : rhs) {
+                const uint32_t id = id_of(sym);
+                if (id == NONE || id == end_) {
+                    throw std::runtime_error("Unknown symbol " + sym + " in production of " + lhs);
+                }
+                p.rhs.push_back(id);
+            }
+
+            by_lhs_[a].push_back(productions_.size());
+            productions_.push_back(std::move(p));
+        }
+    }
+
+    compute_nullable();
+    compute_first();
+    compute_follow();
+}
+
+inline void GrammarAnalysis::compute_nullable() {
+    nullable_.assign(names_.size(), false);
+
+    std::vector<uint32_t> need(productions_.size());
+    std::vector<std::vector<uint32_t>> uses(names_.size());
+    std::vector<uint32_t> worklist;
+
+    for (uint32_t p = 0; p < productions_.size(); ++p) {
+        for (uint32_t sym : productions_[p].rhs) {
+            uses[sym].push_back(p);
+        }
+        need[p] = productions_[p].rhs.size();
+
+        if (need[p] == 0 && !nullable_[productions_[p].lhs]) {
+            nullable_[productions_[p].lhs] = true;
+            worklist.push_back(productions_[p].lhs);
+        }
+    }
+
+    while (!worklist.empty()) {
+        const uint32_t sym = worklist.back();
+        worklist.pop_back();
+
+        for (uint32_t p : uses[sym]) {
+            if (--need[p] == 0 && !nullable_[productions_[p].lhs]) {
+                nullable_[productions_[p].lhs] = true;
+                worklist.push_back(productions_[p].lhs);
+            }
+        }
+    }
+}
+
+inline void GrammarAnalysis::compute_first() {
+    first_.assign(names_.size(), TerminalSet(end_ + 1));
+    for (uint32_t t = 0; t <= end_; ++t) {
+        first_[t].insert(t);
+    }
+
+    // FIRST(B) flows into FIRST(A) for every A -> α B β with α nullable
+    std::vector<std::vector<uint32_t>> flows_into(names_.size());
+
+    for (const auto& p : productions_) {
+        for (uint32_t sym : p.rhs) {
+            if (is_terminal(sym)) {
+                first_[p.lhs].insert(sym);
+                break;
+            }
+
+            flows_into[sym].push_back(p.lhs);
+            if (!nullable_[sym]) break;
+        }
+    }
+
+    std::vector<uint32_t> worklist;
+    std::vector<bool> queued(names_.size(), false);
+    for (uint32_t nt = end_ + 1; nt < names_.size(); ++nt) {
+        worklist.push_back(nt);
+        queued[nt] = true;
+    }
+
+    while (!worklist.empty()) {
+        const uint32_t b = worklist.back();
+        worklist.pop_back();
+        queued[b] = false;
+
+        for (uint32_t a : flows_into[b]) {
+            if (first_[a].merge(first_[b]) && !queued[a]) {
+                queued[a] = true;
+                worklist.push_back(a);
+            }
+        }
+    }
+}
+
+inline void GrammarAnalysis::compute_follow() {
+    follow_.assign(names_.size(), TerminalSet(end_ + 1));
+    follow_[start_].insert(end_);
+
+    // FOLLOW(A) flows into FOLLOW(B) for every A -> α B β with β nullable
+    std::vector<std::vector<uint32_t>> flows_into(names_.size());
+
+    for (const auto& p : productions_) {
+        const uint32_t* rhs = p.rhs.data();
+        const size_t n = p.rhs.size();
+
+        for (size_t i = 0; i < n; ++i) {
+            if (is_terminal(rhs[i])) continue;
+
+            if (first_of(rhs + i + 1, rhs + n, follow_[rhs[i]])) {
+                flows_into[p.lhs].push_back(rhs[i]);
+            }
+        }
+    }
+
+    std::vector<uint32_t> worklist;
+    std::vector<bool> queued(names_.size(), false);
+    for (uint32_t nt = end_ + 1; nt < names_.size(); ++nt) {
+        worklist.push_back(nt);
+        queued[nt] = true;
+    }
+
+    while (!worklist.empty()) {
+        const uint32_t a = worklist.back();
+        worklist.pop_back();
+        queued[a] = false;
+
+        for (uint32_t b : flows_into[a]) {
+            if (follow_[b].merge(follow_[a]) && !queued[b]) {
+                queued[b] = true;
+                worklist.push_back(b);
+            }
+        }
+    }
+}
+
+inline bool GrammarAnalysis::first_of(const uint32_t* begin, const uint32_t* end, TerminalSet& out) const {
+    for (const uint32_t* it = begin; it != end; ++it) {
+        out.merge(first_[*it]);
+        if (!nullable_[*it]) return false;
+    }
+    return true;
+}
+
+inline std::string GrammarAnalysis::production_to_string(size_t p) const {
+    std::string out = names_[productions_[p].lhs] + " ->";
+    if (productions_[p].rhs.empty()) {
+        out += " ε";
+    }
+    for (uint32_t sym : productions_[p].rhs) {
+        out += ' ';
+        out += names_[sym];
+    }
+    return out;
+}
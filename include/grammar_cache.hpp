@@ -0,0 +1,337 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unistd.h>
+#include <vector>
+#include "chomsky_normal_form.hpp"
+#include "mapped_file.hpp"
+
+// On-disk cache of ChomskyNormalForm results, keyed by a hash of the canonical form of
+// the input.
+//
+// The canonical form walks the grammar in sorted order (symbols, lhs list, and the rhs
+// list of every lhs), so it does not depend on the iteration order of the unordered_map
+// or on the order the productions were written in. Every name is preceded by its
+// length and every list by its count, so two different grammars never have the same
+// canonical form. The key also covers ChomskyNormalForm::VERSION, and a file keeps the
+// canonical form of its input, which a load compares against: a hash collision is a
+// miss, not someone else's grammar.
+//
+// Cached grammars are stored in a compact binary form that is parsed straight out of
+// an mmap'd file:
+//
+//   "CNFG"  u32 version  u64 key
+//   u32 length + bytes of the canonical form of the input
+//   u32 symbol count, then per symbol: u32 length + bytes
+//   u32 start symbol id
+//   u32 1 if the grammar is weighted, 0 otherwise
+//   u32 count + ids of the non-terminals, same for the terminals
+//   u32 lhs count, then per lhs: u32 lhs id, u32 rhs count, then per rhs: u32 length + ids,
+//   followed by an f64 weight in weighted grammars
+//
+// All integers are little endian, in the canonical form as well.
+
+static inline uint64_t fnv1a(uint64_t h, std::string_view bytes) {
+    for (unsigned char c : bytes) {
+        h ^= c;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static inline void put_le(std::string& out, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>(v >> (8 * i)));
+    }
+}
+
+static inline std::string canonical_grammar(const Grammar& g) {
+    std::string out;
+
+    auto add = [&](std::string_view s) {
+        put_le(out, s.size(), 4);
+        out.append(s);
+    };
+
+    add(g.start_symbol);
+
+    // std::set is already ordered
+    put_le(out, g.non_terminals.size(), 4);
+    for (const auto& nt : g.non_terminals) add(nt);
+    put_le(out, g.terminals.size(), 4);
+    for (const auto& t : g.terminals) add(t);
+
+    std::vector<Grammar::LHS> lhs_list;
+    for (const auto& [lhs, _] : g.productions) lhs_list.push_back(lhs);
+    std::ranges::sort(lhs_list);
+
+    const bool weighted = g.is_weighted();
+    put_le(out, weighted, 1);
+    put_le(out, lhs_list.size(), 4);
+
+    for (const auto& lhs : lhs_list) {
+        const auto& rhses = g.productions.at(lhs);
+        auto wit = g.weights.find(lhs);
+
+        std::vector<std::pair<Grammar::RHS, double>> rules;
+        for (size_t i = 0; i < rhses.size(); ++i) {
+            rules.push_back({ rhses[i], wit != g.weights.end() ? wit->second.at(i) : 0.0 });
+        }
+        std::ranges::sort(rules);
+
+        add(lhs);
+        put_le(out, rules.size(), 4);
+        for (const auto& [rhs, weight] : rules) {
+            put_le(out, rhs.size(), 4);
+            for (const auto& sym : rhs) add(sym);
+            if (weighted) put_le(out, std::bit_cast<uint64_t>(weight), 8);
+        }
+    }
+
+    return out;
+}
+
+static inline uint64_t grammar_hash(const Grammar& g) {
+    return fnv1a(0xcbf29ce484222325ull, canonical_grammar(g));
+}
+
+class GrammarCache {
+public:
+    explicit GrammarCache(std::filesystem::path dir)
+        : dir_{std::move(dir)} {
+        std::filesystem::create_directories(dir_);
+    };
+
+    // ChomskyNormalForm::normalize, skipped when the same grammar was normalized before
+    Grammar normalize(const Grammar& g) const;
+
+    // input is the canonical form of the grammar that was normalized
+    std::optional<Grammar> load(uint64_t key, std::string_view input) const;
+    void store(uint64_t key, std::string_view input, const Grammar& cnf) const;
+
+    static uint64_t key_for(std::string_view input);
+    static std::string serialize(uint64_t key, std::string_view input, const Grammar& g);
+    static std::optional<Grammar> deserialize(uint64_t key, std::string_view input, std::string_view bytes);
+
+private:
+    static constexpr char MAGIC[4] = { 'C', 'N', 'F', 'G' };
+    static constexpr uint32_t VERSION = 3;
+
+    std::filesystem::path path_for(uint64_t key) const;
+
+    std::filesystem::path dir_;
+};
+
+inline std::filesystem::path GrammarCache::path_for(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.cnf", static_cast<unsigned long long>(key));
+    return dir_ / name;
+}
+
+inline uint64_t GrammarCache::key_for(std::string_view input) {
+    std::string version;
+    put_le(version, ChomskyNormalForm::VERSION, 4);
+    return fnv1a(fnv1a(0xcbf29ce484222325ull, version), input);
+}
+
+inline std::string GrammarCache::serialize(uint64_t key, std::string_view input, const Grammar& g) {
+    std::string out;
+
+    auto put32 = [&](uint32_t v) { put_le(out, v, 4); };
+    auto put64 = [&](uint64_t v) { put_le(out, v, 8); };
+
+    std::vector<Grammar::Symbol> symbols;
+    std::unordered_map<Grammar::Symbol, uint32_t> ids;
+    auto intern = [&](const Grammar::Symbol& s) {
+        auto [it, inserted] = ids.try_emplace(s, symbols.size());
+        if (inserted) symbols.push_back(s);
+        return it->second;
+    };
+
+    intern(g.start_symbol);
+    for (const auto& nt : g.non_terminals) intern(nt);
+    for (const auto& t : g.terminals) intern(t);
+    for (const auto& [lhs, rhses] : g.productions) {
+        intern(lhs);
+        for (const auto& rhs : rhses) {
+            for (const auto& sym : rhs) intern(sym);
+        }
+    }
+
+    out.append(MAGIC, sizeof(MAGIC));
+    put32(VERSION);
+    put64(key);
+
+    put32(input.size());
+    out.append(input);
+
+    put32(symbols.size());
+    for (const auto& s : symbols) {
+        put32(s.size());
+        out.append(s);
+    }
+
+    put32(ids.at(g.start_symbol));
+    put32(g.is_weighted() ? 1 : 0);
+
+    put32(g.non_terminals.size());
+    for (const auto& nt : g.non_terminals) put32(ids.at(nt));
+    put32(g.terminals.size());
+    for (const auto& t : g.terminals) put32(ids.at(t));
+
+    put32(g.productions.size());
+    for (const auto& [lhs, rhses] : g.productions) {
+        put32(ids.at(lhs));
+        put32(rhses.size());
+
+        for (size_t i = 0; i < rhses.size(); ++i) {
+            put32(rhses[i].size());
+            for (const auto& sym : rhses[i]) put32(ids.at(sym));
+            if (g.is_weighted()) put64(std::bit_cast<uint64_t>(g.weights.at(lhs).at(i)));
+        }
+    }
+
+    return out;
+}
+
+inline std::optional<Grammar> GrammarCache::deserialize(
+    uint64_t key,
+    std::string_view input,
+    std::string_view bytes
+) {
+    size_t pos = 0;
+    bool ok = true;
+
+    auto take = [&](size_t n) {
+        if (!ok || bytes.size() - pos < n) {
+            ok = false;
+            return std::string_view{};
+        }
+        auto out = bytes.substr(pos, n);
+        pos += n;
+        return out;
+    };
+    auto get_le = [&](size_t n) {
+        uint64_t v = 0;
+        auto raw = take(n);
+        for (size_t i = 0; i < raw.size(); ++i) {
+            v |= uint64_t{static_cast<unsigned char>(raw[i])} << (8 * i);
+        }
+        return v;
+    };
+    auto get32 = [&]() { return static_cast<uint32_t>(get_le(4)); };
+    auto get64 = [&]() { return get_le(8); };
+
+    if (take(sizeof(MAGIC)) != std::string_view(MAGIC, sizeof(MAGIC)) || get32() != VERSION || get64() != key) {
+        return std::nullopt;
+    }
+
+    // same key, different grammar: a collision
+    if (take(get32()) != input || !ok) {
+        return std::nullopt;
+    }
+
+    // a count of u32 records, capped by what is left so a corrupt file cannot make us allocate
+    auto count = [&]() {
+        uint32_t n = get32();
+        if (n > (bytes.size() - pos) / sizeof(uint32_t)) {
+            ok = false;
+            return uint32_t{0};
+        }
+        return n;
+    };
+
+    std::vector<Grammar::Symbol> symbols(count());
+    for (auto& s : symbols) {
+        s = take(get32());
+        if (!ok) return std::nullopt;
+    }
+
+    auto symbol = [&]() -> Grammar::Symbol {
+        uint32_t id = get32();
+        if (!ok || id >= symbols.size()) {
+            ok = false;
+            return {};
+        }
+        return symbols[id];
+    };
+
+    Grammar g;
+    g.start_symbol = symbol();
+    const bool weighted = get32() != 0;
+
+    for (uint32_t n = count(); ok && n > 0; --n) g.non_terminals.insert(symbol());
+    for (uint32_t n = count(); ok && n > 0; --n) g.terminals.insert(symbol());
+
+    for (uint32_t n = count(); ok && n > 0; --n) {
+        const auto lhs = symbol();
+        auto& rhses = g.productions[lhs];
+        rhses.resize(count());
+        if (weighted) g.weights[lhs].reserve(rhses.size());
+
+        for (auto& rhs : rhses) {
+            rhs.resize(count());
+            for (auto& sym : rhs) sym = symbol();
+            if (weighted) g.weights[lhs].push_back(std::bit_cast<double>(get64()));
+            if (!ok) return std::nullopt;
+        }
+    }
+
+    if (!ok || pos != bytes.size()) {
+        return std::nullopt;
+    }
+
+    return g;
+}
+
+inline std::optional<Grammar> GrammarCache::load(uint64_t key, std::string_view input) const {
+    auto path = path_for(key);
+    if (!std::filesystem::exists(path)) {
+        return std::nullopt;
+    }
+
+    MappedFile file(path.string());
+    return deserialize(key, input, file.view());
+}
+
+inline void GrammarCache::store(uint64_t key, std::string_view input, const Grammar& cnf) const {
+    auto path = path_for(key);
+    auto tmp = path;
+    tmp += ".tmp" + std::to_string(::getpid());
+
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        const std::string bytes = serialize(key, input, cnf);
+        out.write(bytes.data(), bytes.size());
+        if (!out) {
+            throw std::runtime_error("Could not write grammar cache file: " + tmp.string());
+        }
+    }
+
+    // readers either see the old file or the complete new one
+    std::filesystem::rename(tmp, path);
+}
+
+inline Grammar GrammarCache::normalize(const Grammar& g) const {
+    const std::string input = canonical_grammar(g);
+    const uint64_t key = key_for(input);
+
+    if (auto cached = load(key, input)) {
+        return std::move(*cached);
+    }
+
+    ChomskyNormalForm chomsky_normal_form(g);
+    chomsky_normal_form.normalize();
+    Grammar result = chomsky_normal_form.result();
+
+    store(key, input, result);
+    return result;
+}
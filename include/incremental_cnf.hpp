@@ -0,0 +1,723 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "cnf_grammar.hpp"
+
+// Keeps a grammar in Chomsky normal form while productions are added and removed.
+//
+// The source rules are first binarized (BIN): a rule X -> s1 s2 ... sk with k > 2
+// becomes X -> s1 H(s2..sk), where the helper H(σ) is keyed by the suffix σ itself,
+// so identical suffixes share one helper and a helper lives exactly as long as some
+// rule still needs it. On that binarized grammar we maintain
+//
+//   - the nullable set and the productive set, each with a per-rule counter of
+//     symbols that do not have the property yet (the same counting scheme as
+//     ChomskyNormalForm::DEL and eliminate_non_productive_sym),
+//   - the solid set, non-terminals deriving some non-empty string: a productive rule
+//     with a terminal or a solid symbol in it. A symbol deriving only ε has no rules
+//     after DEL, so the output never mentions it, as ChomskyNormalForm drops it too,
+//   - the unit graph (Y -> Z whenever deleting nullable symbols leaves just Z),
+//   - the CNF rules of every non-terminal, derived from the non-unit rules of its
+//     unit closure with DEL applied and terminals wrapped (TERM),
+//   - the set of non-terminals reachable from the start symbol in the output.
+//
+// An edit only touches the non-terminals whose rules, nullability, productivity or
+// unit closure actually changed. Adding rules can only grow the nullable/productive
+// sets, so those are propagated forward; removing a rule clears the candidates that
+// may have depended on it and re-derives just that region.
+
+class IncrementalCNF {
+public:
+    explicit IncrementalCNF(Grammar g);
+
+    void add_production(const Grammar::LHS& lhs, Grammar::RHS rhs);
+    void remove_production(const Grammar::LHS& lhs, const Grammar::RHS& rhs);
+
+    // the grammar as edited so far
+    const Grammar& source() const { return source_; }
+    // the normalized grammar
+    Grammar result() const;
+
+private:
+    struct Rule {
+        Grammar::LHS lhs;
+        Grammar::RHS rhs;
+    };
+
+    // rule ids touched by one edit
+    struct Edit {
+        std::vector<size_t> added;
+        std::vector<size_t> removed;
+    };
+
+    // a property every rhs symbol must have for the lhs to get it
+    struct Fixpoint {
+        std::unordered_set<Grammar::Symbol> holds;
+        std::vector<int> need;
+        bool terminals_hold;
+    };
+
+    bool is_non_terminal(const Grammar::Symbol& s) const {
+        return source_.non_terminals.contains(s) || helper_rule_.contains(s) || s == start_;
+    }
+
+    std::string fresh_name(const std::string& prefix);
+
+    void add_source_rule(const Grammar::LHS& lhs, const Grammar::RHS& rhs, Edit& edit);
+    size_t add_rule(const Grammar::LHS& lhs, Grammar::RHS rhs, Edit& edit);
+    void remove_rule(size_t id, Edit& edit);
+
+    Grammar::Symbol acquire_helper(const Grammar::RHS& suffix, Edit& edit);
+    void release_helper(const Grammar::Symbol& name, Edit& edit);
+    Grammar::Symbol acquire_wrapper(const Grammar::Symbol& terminal);
+    void release_wrapper(const Grammar::Symbol& name);
+
+    void apply(const Edit& edit);
+    std::unordered_set<Grammar::Symbol> update_fixpoint(Fixpoint& fp, const Edit& edit);
+    int count_missing(const Fixpoint& fp, const Rule& rule) const;
+    void mark(Fixpoint& fp, const Grammar::Symbol& sym, std::unordered_set<Grammar::Symbol>& marked);
+    std::unordered_set<Grammar::Symbol> update_solid(
+        const Edit& edit,
+        const std::unordered_set<Grammar::Symbol>& changed_productive
+    );
+
+    bool is_solid(const Grammar::Symbol& s) const {
+        return !is_non_terminal(s) || solid_.contains(s);
+    }
+
+    void recompute_unit_edges(const Grammar::LHS& lhs);
+    void collect_unit_ancestors(const Grammar::Symbol& sym, std::unordered_set<Grammar::Symbol>& out) const;
+    // returns false if some rule disappeared from the output of lhs
+    bool regenerate(const Grammar::LHS& lhs);
+    void extend_reachable(const Grammar::Symbol& from);
+    void recompute_reachable();
+
+    Grammar source_;
+    Grammar::Symbol start_;
+    std::unordered_set<std::string> taken_;
+
+    // the binarized grammar, rule ids are never reused
+    std::vector<Rule> rules_;
+    std::vector<bool> alive_;
+    std::unordered_map<Grammar::LHS, std::vector<size_t>> rules_of_;
+    // symbol -> rules mentioning it, once per occurrence
+    std::unordered_map<Grammar::Symbol, std::vector<size_t>> uses_;
+    // (lhs, source rhs) -> binarized rule ids, one per copy of the production
+    std::map<std::pair<Grammar::LHS, Grammar::RHS>, std::vector<size_t>> source_rules_;
+
+    std::map<Grammar::RHS, Grammar::Symbol> helpers_;
+    std::unordered_map<Grammar::Symbol, size_t> helper_rule_;
+    std::unordered_map<Grammar::Symbol, int> helper_refs_;
+
+    std::unordered_map<Grammar::Symbol, Grammar::Symbol> wrappers_;
+    std::unordered_map<Grammar::Symbol, int> wrapper_refs_;
+
+    Fixpoint nullable_{ {}, {}, false };
+    Fixpoint productive_{ {}, {}, true };
+    std::unordered_set<Grammar::Symbol> solid_;
+
+    std::unordered_map<Grammar::LHS, std::set<Grammar::Symbol>> unit_edges_;
+    std::unordered_map<Grammar::Symbol, std::set<Grammar::LHS>> unit_parents_;
+
+    std::unordered_map<Grammar::LHS, std::vector<Grammar::RHS>> output_;
+    std::unordered_map<Grammar::LHS, std::vector<Grammar::Symbol>> owned_wrappers_;
+    std::unordered_set<Grammar::Symbol> reachable_;
+};
+
+inline IncrementalCNF::IncrementalCNF(Grammar g)
+    : source_{std::move(g)} {
+    if (source_.is_weighted()) {
+        throw std::runtime_error("IncrementalCNF does not support weighted grammars");
+    }
+
+    taken_.insert(source_.non_terminals.begin(), source_.non_terminals.end());
+    taken_.insert(source_.terminals.begin(), source_.terminals.end());
+
+    // START: a fresh start symbol that never shows up on a right hand side
+    start_ = fresh_name("S");
+
+    Edit edit;
+    add_rule(start_, { source_.start_symbol }, edit);
+
+    for (const auto& [lhs, rhses] : source_.productions) {
+        for (const auto& rhs : rhses) {
+            add_source_rule(lhs, rhs, edit);
+        }
+    }
+
+    apply(edit);
+}
+
+inline std::string IncrementalCNF::fresh_name(const std::string& prefix) {
+    if (taken_.insert(prefix).second) {
+        return prefix;
+    }
+
+    int id = 0;
+    while (true) {
+        std::string candidate = prefix + std::to_string(id++);
+        if (taken_.insert(candidate).second) {
+            return candidate;
+        }
+    }
+}
+
+inline void IncrementalCNF::add_production(const Grammar::LHS& lhs, Grammar::RHS rhs) {
+    if (source_.terminals.contains(lhs)) {
+        throw std::runtime_error("Terminal " + lhs + " cannot be the lhs of a production");
+    }
+
+    if (!source_.non_terminals.contains(lhs)) {
+        if (taken_.contains(lhs)) {
+            throw std::runtime_error("Non-terminal " + lhs + " clashes with a generated symbol");
+        }
+        source_.non_terminals.insert(lhs);
+        taken_.insert(lhs);
+    }
+
+    for (const auto& sym : rhs) {
+        if (!source_.terminals.contains(sym) && !source_.non_terminals.contains(sym)) {
+            throw std::runtime_error("Unknown symbol " + sym + " in production of " + lhs);
+        }
+    }
+
+    Edit edit;
+    add_source_rule(lhs, rhs, edit);
+    source_.productions[lhs].push_back(std::move(rhs));
+    apply(edit);
+}
+
+inline void IncrementalCNF::remove_production(const Grammar::LHS& lhs, const Grammar::RHS& rhs) {
+    auto pit = source_.productions.find(lhs);
+    if (pit == source_.productions.end()) {
+        throw std::runtime_error("No production " + lhs + " to remove");
+    }
+
+    auto& rhses = pit->second;
+    auto rit = std::ranges::find(rhses, rhs);
+    if (rit == rhses.end()) {
+        throw std::runtime_error("No such production of " + lhs + " to remove");
+    }
+    rhses.erase(rit);
+
+    auto sit = source_rules_.find({ lhs, rhs });
+    size_t id = sit->second.back();
+    sit->second.pop_back();
+    if (sit->second.empty()) {
+        source_rules_.erase(sit);
+    }
+
+    Edit edit;
+    if (rhs.size() > 2) {
+        release_helper(rules_[id].rhs[1], edit);
+    }
+    remove_rule(id, edit);
+    apply(edit);
+}
+
+inline void IncrementalCNF::add_source_rule(const Grammar::LHS& lhs, const Grammar::RHS& rhs, Edit& edit) {
+    Grammar::RHS binary = rhs;
+    if (rhs.size() > 2) {
+        binary = { rhs[0], acquire_helper(Grammar::RHS(rhs.begin() + 1, rhs.end()), edit) };
+    }
+
+    source_rules_[{ lhs, rhs }].push_back(add_rule(lhs, std::move(binary), edit));
+}
+
+inline size_t IncrementalCNF::add_rule(const Grammar::LHS& lhs, Grammar::RHS rhs, Edit& edit) {
+    size_t id = rules_.size();
+
+    for (const auto& sym : rhs) {
+        uses_[sym].push_back(id);
+    }
+
+    rules_.push_back({ lhs, std::move(rhs) });
+    alive_.push_back(true);
+    nullable_.need.push_back(0);
+    productive_.need.push_back(0);
+    rules_of_[lhs].push_back(id);
+    edit.added.push_back(id);
+    return id;
+}
+
+inline void IncrementalCNF::remove_rule(size_t id, Edit& edit) {
+    alive_[id] = false;
+
+    for (const auto& sym : rules_[id].rhs) {
+        std::erase(uses_[sym], id);
+    }
+
+    std::erase(rules_of_[rules_[id].lhs], id);
+    edit.removed.push_back(id);
+}
+
+inline Grammar::Symbol IncrementalCNF::acquire_helper(const Grammar::RHS& suffix, Edit& edit) {
+    auto it = helpers_.find(suffix);
+    if (it != helpers_.end()) {
+        helper_refs_[it->second]++;
+        return it->second;
+    }
+
+    Grammar::Symbol tail = suffix.size() > 2
+        ? acquire_helper(Grammar::RHS(suffix.begin() + 1, suffix.end()), edit)
+        : suffix[1];
+
+    Grammar::Symbol name = fresh_name("A");
+    helpers_.emplace(suffix, name);
+    helper_refs_[name] = 1;
+    helper_rule_[name] = add_rule(name, { suffix[0], tail }, edit);
+    return name;
+}
+
+inline void IncrementalCNF::release_helper(const Grammar::Symbol& name, Edit& edit) {
+    if (--helper_refs_[name] > 0) {
+        return;
+    }
+
+    size_t id = helper_rule_.at(name);
+    const Grammar::Symbol tail = rules_[id].rhs[1];
+    if (helper_rule_.contains(tail)) {
+        release_helper(tail, edit);
+    }
+    remove_rule(id, edit);
+
+    std::erase_if(helpers_, [&](const auto& h) { return h.second == name; });
+    helper_rule_.erase(name);
+    helper_refs_.erase(name);
+    taken_.erase(name);
+}
+
+inline Grammar::Symbol IncrementalCNF::acquire_wrapper(const Grammar::Symbol& terminal) {
+    auto it = wrappers_.find(terminal);
+    if (it == wrappers_.end()) {
+        it = wrappers_.emplace(terminal, fresh_name("N" + terminal)).first;
+    }
+
+    wrapper_refs_[it->second]++;
+    return it->second;
+}
+
+inline void IncrementalCNF::release_wrapper(const Grammar::Symbol& name) {
+    if (--wrapper_refs_[name] > 0) {
+        return;
+    }
+
+    wrapper_refs_.erase(name);
+    std::erase_if(wrappers_, [&](const auto& w) { return w.second == name; });
+    taken_.erase(name);
+}
+
+inline int IncrementalCNF::count_missing(const Fixpoint& fp, const Rule& rule) const {
+    int missing = 0;
+    for (const auto& sym : rule.rhs) {
+        bool has = is_non_terminal(sym) ? fp.holds.contains(sym) : fp.terminals_hold;
+        missing += !has;
+    }
+    return missing;
+}
+
+inline void IncrementalCNF::mark(
+    Fixpoint& fp,
+    const Grammar::Symbol& sym,
+    std::unordered_set<Grammar::Symbol>& marked
+) {
+    std::vector<Grammar::Symbol> worklist = { sym };
+    fp.holds.insert(sym);
+    marked.insert(sym);
+
+    while (!worklist.empty()) {
+        Grammar::Symbol cur = std::move(worklist.back());
+        worklist.pop_back();
+
+        for (size_t r : uses_[cur]) {
+            const auto& lhs = rules_[r].lhs;
+            if (--fp.need[r] == 0 && fp.holds.insert(lhs).second) {
+                marked.insert(lhs);
+                worklist.push_back(lhs);
+            }
+        }
+    }
+}
+
+inline std::unordered_set<Grammar::Symbol> IncrementalCNF::update_fixpoint(Fixpoint& fp, const Edit& edit) {
+    // everything that may have relied on a removed rule loses the property for now
+    std::vector<Grammar::Symbol> cleared;
+    for (size_t r : edit.removed) {
+        const auto& lhs = rules_[r].lhs;
+        if (fp.holds.erase(lhs)) {
+            cleared.push_back(lhs);
+        }
+    }
+
+    for (size_t i = 0; i < cleared.size(); ++i) {
+        for (size_t r : uses_[cleared[i]]) {
+            const auto& lhs = rules_[r].lhs;
+            if (fp.holds.erase(lhs)) {
+                cleared.push_back(lhs);
+            }
+        }
+    }
+
+    for (const auto& sym : cleared) {
+        for (size_t r : uses_[sym]) {
+            fp.need[r] = count_missing(fp, rules_[r]);
+        }
+    }
+
+    for (size_t r : edit.added) {
+        if (alive_[r]) {
+            fp.need[r] = count_missing(fp, rules_[r]);
+        }
+    }
+
+    // re-derive the cleared region and push the new rules through
+    std::vector<size_t> seeds(edit.added.begin(), edit.added.end());
+    for (const auto& sym : cleared) {
+        const auto& own = rules_of_[sym];
+        seeds.insert(seeds.end(), own.begin(), own.end());
+    }
+
+    std::unordered_set<Grammar::Symbol> marked;
+    for (size_t r : seeds) {
+        if (alive_[r] && fp.need[r] == 0 && !fp.holds.contains(rules_[r].lhs)) {
+            mark(fp, rules_[r].lhs, marked);
+        }
+    }
+
+    std::unordered_set<Grammar::Symbol> changed;
+    for (const auto& sym : cleared) {
+        if (!fp.holds.contains(sym)) changed.insert(sym);
+    }
+    for (const auto& sym : marked) {
+        if (std::ranges::find(cleared, sym) == cleared.end()) changed.insert(sym);
+    }
+
+    return changed;
+}
+
+inline std::unordered_set<Grammar::Symbol> IncrementalCNF::update_solid(
+    const Edit& edit,
+    const std::unordered_set<Grammar::Symbol>& changed_productive
+) {
+    std::vector<Grammar::Symbol> cleared;
+    auto clear = [&](const Grammar::Symbol& sym) {
+        if (solid_.erase(sym)) cleared.push_back(sym);
+    };
+
+    // what may have been solid through a removed rule or a symbol no longer productive
+    for (size_t r : edit.removed) {
+        clear(rules_[r].lhs);
+    }
+    for (const auto& sym : changed_productive) {
+        if (productive_.holds.contains(sym)) continue;
+
+        clear(sym);
+        for (size_t r : uses_[sym]) clear(rules_[r].lhs);
+    }
+    for (size_t i = 0; i < cleared.size(); ++i) {
+        for (size_t r : uses_[cleared[i]]) clear(rules_[r].lhs);
+    }
+
+    // a symbol only turns solid through a productive rule, so no counters are needed:
+    // a rule is checked again whenever one of its symbols turns solid
+    auto satisfied = [&](size_t r) {
+        return alive_[r] && productive_.need[r] == 0 &&
+               std::ranges::any_of(rules_[r].rhs, [&](const auto& sym) { return is_solid(sym); });
+    };
+
+    std::vector<size_t> seeds(edit.added.begin(), edit.added.end());
+    for (const auto& sym : cleared) {
+        const auto& own = rules_of_[sym];
+        seeds.insert(seeds.end(), own.begin(), own.end());
+    }
+    for (const auto& sym : changed_productive) {
+        if (!productive_.holds.contains(sym)) continue;
+
+        const auto& used = uses_[sym];
+        seeds.insert(seeds.end(), used.begin(), used.end());
+    }
+
+    std::unordered_set<Grammar::Symbol> marked;
+    std::vector<Grammar::Symbol> worklist;
+    auto try_rule = [&](size_t r) {
+        if (satisfied(r) && solid_.insert(rules_[r].lhs).second) {
+            marked.insert(rules_[r].lhs);
+            worklist.push_back(rules_[r].lhs);
+        }
+    };
+
+    for (size_t r : seeds) try_rule(r);
+    while (!worklist.empty()) {
+        Grammar::Symbol cur = std::move(worklist.back());
+        worklist.pop_back();
+
+        for (size_t r : uses_[cur]) try_rule(r);
+    }
+
+    std::unordered_set<Grammar::Symbol> changed;
+    for (const auto& sym : cleared) {
+        if (!solid_.contains(sym)) changed.insert(sym);
+    }
+    for (const auto& sym : marked) {
+        if (std::ranges::find(cleared, sym) == cleared.end()) changed.insert(sym);
+    }
+
+    return changed;
+}
+
+inline void IncrementalCNF::recompute_unit_edges(const Grammar::LHS& lhs) {
+    auto old = unit_edges_.find(lhs);
+    if (old != unit_edges_.end()) {
+        for (const auto& child : old->second) {
+            unit_parents_[child].erase(lhs);
+        }
+        unit_edges_.erase(old);
+    }
+
+    std::set<Grammar::Symbol> edges;
+    auto rit = rules_of_.find(lhs);
+    if (rit != rules_of_.end()) {
+        for (size_t r : rit->second) {
+            if (productive_.need[r] != 0) continue;
+
+            const auto& rhs = rules_[r].rhs;
+            for (size_t i = 0; i < rhs.size(); ++i) {
+                // the rest of the rule has to vanish for rhs[i] to stand alone
+                bool rest_nullable = true;
+                for (size_t k = 0; k < rhs.size(); ++k) {
+                    if (k != i && !nullable_.holds.contains(rhs[k])) rest_nullable = false;
+                }
+
+                if (rest_nullable && is_non_terminal(rhs[i])) {
+                    edges.insert(rhs[i]);
+                }
+            }
+        }
+    }
+
+    for (const auto& child : edges) {
+        unit_parents_[child].insert(lhs);
+    }
+
+    if (!edges.empty()) {
+        unit_edges_[lhs] = std::move(edges);
+    }
+}
+
+inline void IncrementalCNF::collect_unit_ancestors(
+    const Grammar::Symbol& sym,
+    std::unordered_set<Grammar::Symbol>& out
+) const {
+    std::vector<Grammar::Symbol> stack = { sym };
+    out.insert(sym);
+
+    while (!stack.empty()) {
+        Grammar::Symbol cur = std::move(stack.back());
+        stack.pop_back();
+
+        auto it = unit_parents_.find(cur);
+        if (it == unit_parents_.end()) continue;
+
+        for (const auto& parent : it->second) {
+            if (out.insert(parent).second) {
+                stack.push_back(parent);
+            }
+        }
+    }
+}
+
+inline bool IncrementalCNF::regenerate(const Grammar::LHS& lhs) {
+    std::vector<Grammar::RHS> old;
+    if (auto it = output_.find(lhs); it != output_.end()) {
+        old = std::move(it->second);
+        output_.erase(it);
+    }
+
+    if (auto it = owned_wrappers_.find(lhs); it != owned_wrappers_.end()) {
+        for (const auto& w : it->second) release_wrapper(w);
+        owned_wrappers_.erase(it);
+    }
+
+    if (!productive_.holds.contains(lhs)) {
+        return old.empty();
+    }
+
+    // UNIT: collect the unit closure first
+    std::vector<Grammar::Symbol> closure = { lhs };
+    std::unordered_set<Grammar::Symbol> seen = { lhs };
+    for (size_t i = 0; i < closure.size(); ++i) {
+        auto it = unit_edges_.find(closure[i]);
+        if (it == unit_edges_.end()) continue;
+
+        for (const auto& child : it->second) {
+            if (seen.insert(child).second) closure.push_back(child);
+        }
+    }
+
+    std::vector<Grammar::RHS> rhses;
+    auto emit = [&](Grammar::RHS rhs) {
+        // unit variants are covered by the closure
+        if (rhs.size() == 1 && is_non_terminal(rhs[0])) return;
+        rhses.push_back(std::move(rhs));
+    };
+
+    // DEL on rules of length <= 2, keeping only variants of solid symbols
+    for (const auto& member : closure) {
+        auto rit = rules_of_.find(member);
+        if (rit == rules_of_.end()) continue;
+
+        for (size_t r : rit->second) {
+            if (productive_.need[r] != 0) continue;
+
+            const auto& rhs = rules_[r].rhs;
+            if (rhs.size() == 1) {
+                if (is_solid(rhs[0])) emit(rhs);
+            } else if (rhs.size() == 2) {
+                if (is_solid(rhs[0]) && is_solid(rhs[1])) emit(rhs);
+                if (nullable_.holds.contains(rhs[0]) && is_solid(rhs[1])) emit({ rhs[1] });
+                if (nullable_.holds.contains(rhs[1]) && is_solid(rhs[0])) emit({ rhs[0] });
+            }
+        }
+    }
+
+    if (lhs == start_ && nullable_.holds.contains(start_)) {
+        rhses.push_back({});
+    }
+
+    std::ranges::sort(rhses);
+    auto [first, last] = std::ranges::unique(rhses);
+    rhses.erase(first, last);
+
+    // TERM on the binary rules
+    std::vector<Grammar::Symbol> wrappers;
+    for (auto& rhs : rhses) {
+        if (rhs.size() != 2) continue;
+
+        for (auto& sym : rhs) {
+            if (!is_non_terminal(sym)) {
+                sym = acquire_wrapper(sym);
+                wrappers.push_back(sym);
+            }
+        }
+    }
+
+    if (!wrappers.empty()) {
+        owned_wrappers_[lhs] = std::move(wrappers);
+    }
+
+    bool kept_everything = std::ranges::all_of(old, [&](const auto& rhs) {
+        return std::ranges::find(rhses, rhs) != rhses.end();
+    });
+
+    if (!rhses.empty()) {
+        output_[lhs] = std::move(rhses);
+    }
+
+    return kept_everything;
+}
+
+inline void IncrementalCNF::extend_reachable(const Grammar::Symbol& from) {
+    std::vector<Grammar::Symbol> stack = { from };
+
+    while (!stack.empty()) {
+        Grammar::Symbol cur = std::move(stack.back());
+        stack.pop_back();
+
+        auto it = output_.find(cur);
+        if (it == output_.end()) continue;
+
+        for (const auto& rhs : it->second) {
+            for (const auto& sym : rhs) {
+                if (rhs.size() == 2 && reachable_.insert(sym).second) {
+                    stack.push_back(sym);
+                }
+            }
+        }
+    }
+}
+
+inline void IncrementalCNF::recompute_reachable() {
+    reachable_.clear();
+    if (output_.contains(start_)) {
+        reachable_.insert(start_);
+        extend_reachable(start_);
+    }
+}
+
+inline void IncrementalCNF::apply(const Edit& edit) {
+    auto changed = update_fixpoint(nullable_, edit);
+    auto changed_productive = update_fixpoint(productive_, edit);
+    auto changed_solid = update_solid(edit, changed_productive);
+    changed.insert(changed_productive.begin(), changed_productive.end());
+    changed.insert(changed_solid.begin(), changed_solid.end());
+
+    // non-terminals whose own DEL variants or unit edges may differ now
+    std::unordered_set<Grammar::Symbol> dirty = changed;
+    for (size_t r : edit.added) dirty.insert(rules_[r].lhs);
+    for (size_t r : edit.removed) dirty.insert(rules_[r].lhs);
+    for (const auto& sym : changed) {
+        for (size_t r : uses_[sym]) dirty.insert(rules_[r].lhs);
+    }
+
+    // their unit ancestors inherit their rules, before and after the edit
+    std::unordered_set<Grammar::Symbol> affected;
+    for (const auto& sym : dirty) collect_unit_ancestors(sym, affected);
+    for (const auto& sym : dirty) recompute_unit_edges(sym);
+    for (const auto& sym : dirty) collect_unit_ancestors(sym, affected);
+
+    bool shrunk = false;
+    for (const auto& sym : affected) {
+        shrunk |= !regenerate(sym);
+    }
+
+    for (const auto& sym : dirty) {
+        if (!rules_of_.contains(sym) || !rules_of_.at(sym).empty()) continue;
+        // a helper or non-terminal without rules left, drop its bookkeeping
+        rules_of_.erase(sym);
+        unit_parents_.erase(sym);
+    }
+
+    if (shrunk) {
+        recompute_reachable();
+        return;
+    }
+
+    if (reachable_.empty()) {
+        recompute_reachable();
+        return;
+    }
+
+    for (const auto& sym : affected) {
+        if (reachable_.contains(sym)) extend_reachable(sym);
+    }
+}
+
+inline Grammar IncrementalCNF::result() const {
+    Grammar out;
+    out.start_symbol = start_;
+    out.terminals = source_.terminals;
+    // an empty language still needs a start symbol, it just has no productions
+    out.non_terminals.insert(start_);
+
+    for (const auto& sym : reachable_) {
+        out.non_terminals.insert(sym);
+
+        if (auto it = output_.find(sym); it != output_.end()) {
+            out.productions[sym] = it->second;
+            continue;
+        }
+
+        for (const auto& [terminal, wrapper] : wrappers_) {
+            if (wrapper == sym) out.productions[sym] = {{ terminal }};
+        }
+    }
+
+    return out;
+}
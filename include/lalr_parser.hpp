@@ -0,0 +1,607 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "grammar_analysis.hpp"
+
+// LALR(1) parser generated from a Grammar.
+//
+// The grammar is augmented with S' -> S $. LR(0) items are plain integers: every
+// production owns a block of ids, one per dot position, and a state is identified by
+// its sorted kernel. Lookaheads come from the DeRemer-Pennello relations over the
+// non-terminal transitions (p, A):
+//
+//   DR(p, A)     terminals shifted right after the A transition
+//   reads        (p, A) reads (r, C) when p -A-> r -C-> and C is nullable
+//   includes     (p, A) includes (p', B) when B -> β A γ, p' -β-> p and γ is nullable
+//   lookback     (q, A -> ω) lookback (p, A) when p -ω-> q
+//
+//   Read = DR closed under reads, Follow = Read closed under includes, and the
+//   lookahead of a reduction is the union of Follow over its lookback transitions.
+//
+// Both closures use the SCC-based digraph traversal, so every set is merged once.
+//
+// Conflicts are reported. Shift/reduce conflicts are resolved the yacc way, the shift
+// wins, which is what an ambiguous if/else or expression grammar wants. Reduce/reduce
+// conflicts keep the earlier production in the table, but parsing with them is refused:
+// picking one reduction blindly can send the driver into an endless chain of
+// ε-reductions. The action and goto tables are packed
+// by row displacement (check/value arrays shared by all rows); action rows also get a
+// default reduction, their most common reduce, which is dropped from the row itself.
+//
+// Cyclic grammars (A =>+ A) are refused at parse time too, for the same reason.
+// Shift/reduce conflicts can still loop that way when the grammar hides left recursion
+// behind nullable symbols. The grammar is not cyclic, so a run that never ends has to
+// keep growing the stack without shifting; with conflicts in the table the driver
+// throws once the stack grows past states * (non-terminals + 1) since the last shift.
+
+struct LALRConflict {
+    enum class Kind { ShiftReduce, ReduceReduce };
+
+    // ReduceReduce whenever two or more reductions compete, even if a shift does too
+    Kind kind;
+    uint32_t state;
+    Grammar::Symbol lookahead;
+    bool shift;
+    // the reductions involved
+    std::vector<size_t> productions;
+};
+
+// Row-displacement packed sparse table: row r, column c lives at slot base[r] + c if
+// check says that slot belongs to r.
+class PackedTable {
+public:
+    using Row = std::vector<std::pair<uint32_t, int32_t>>;
+
+    void pack(const std::vector<Row>& rows);
+
+    int32_t get(uint32_t row, uint32_t col, int32_t fallback) const {
+        const size_t slot = size_t{base_[row]} + col;
+        return slot < check_.size() && check_[slot] == row ? value_[slot] : fallback;
+    }
+
+    size_t slots() const { return check_.size(); }
+
+private:
+    static constexpr uint32_t FREE = UINT32_MAX;
+
+    std::vector<uint32_t> base_;
+    std::vector<uint32_t> check_;
+    std::vector<int32_t> value_;
+};
+
+class LALRParser {
+public:
+    explicit LALRParser(const Grammar& g);
+
+    bool is_lalr1() const { return conflicts_.empty(); }
+    const std::vector<LALRConflict>& conflicts() const { return conflicts_; }
+
+    const GrammarAnalysis& analysis() const { return analysis_; }
+    size_t state_count() const { return kernels_.size(); }
+    // slots used by the packed action and goto tables
+    size_t table_slots() const { return action_.slots() + goto_.slots(); }
+
+    bool recognize(const std::vector<Grammar::Symbol>& tokens) const {
+        return run(tokens, nullptr, nullptr);
+    }
+    bool recognize(const std::string& input) const {
+        return recognize(to_symbols(input));
+    }
+
+    // right parse (the reductions in the order they happen), throws on a syntax error
+    std::vector<size_t> parse(const std::vector<Grammar::Symbol>& tokens) const;
+    std::vector<size_t> parse(const std::string& input) const {
+        return parse(to_symbols(input));
+    }
+
+    void print_conflicts(std::ostream& os = std::cout) const;
+
+private:
+    static constexpr int32_t ERROR = 0;
+    static constexpr int32_t ACCEPT = INT32_MIN;
+
+    struct Transition {
+        uint32_t symbol;
+        uint32_t target;
+    };
+
+    bool find_cycle() const;
+    void build_lr0();
+    std::vector<TerminalSet> lookaheads();
+    void build_tables(const std::vector<TerminalSet>& lookahead);
+
+    uint32_t goto_state(uint32_t state, uint32_t symbol) const;
+    bool run(const std::vector<Grammar::Symbol>& tokens, std::vector<size_t>* out, std::string* error) const;
+
+    GrammarAnalysis analysis_;
+
+    // productions of the analysis plus the augmented one at index augmented_
+    std::vector<uint32_t> lhs_;
+    std::vector<std::vector<uint32_t>> rhs_;
+    std::vector<uint32_t> item_offset_;
+    std::vector<uint32_t> item_production_;
+    size_t augmented_;
+
+    std::vector<std::vector<uint32_t>> kernels_;
+    std::vector<std::vector<Transition>> transitions_;
+    // (state, production) pairs of the completed items, one list per state
+    std::vector<std::vector<uint32_t>> reductions_;
+
+    std::vector<LALRConflict> conflicts_;
+    bool cyclic_;
+
+    PackedTable action_;
+    PackedTable goto_;
+    std::vector<int32_t> default_reduction_;
+};
+
+inline void PackedTable::pack(const std::vector<Row>& rows) {
+    base_.assign(rows.size(), 0);
+
+    // dense rows first, the sparse ones fill the gaps they leave
+    std::vector<uint32_t> order(rows.size());
+    for (uint32_t r = 0; r < rows.size(); ++r) order[r] = r;
+    std::ranges::stable_sort(order, [&](uint32_t a, uint32_t b) { return rows[a].size() > rows[b].size(); });
+
+    size_t first_free = 0;
+
+    for (uint32_t r : order) {
+        const auto& row = rows[r];
+        if (row.empty()) continue;
+
+        const uint32_t lowest = row.front().first;
+        size_t base = first_free > lowest ? first_free - lowest : 0;
+
+        while (true) {
+            bool fits = true;
+            for (const auto& [col, _] : row) {
+                if (base + col < check_.size() && check_[base + col] != FREE) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) break;
+            ++base;
+        }
+
+        base_[r] = base;
+        for (const auto& [col, value] : row) {
+            if (base + col >= check_.size()) {
+                check_.resize(base + col + 1, FREE);
+                value_.resize(base + col + 1, 0);
+            }
+            check_[base + col] = r;
+            value_[base + col] = value;
+        }
+
+        while (first_free < check_.size() && check_[first_free] != FREE) ++first_free;
+    }
+}
+
+inline LALRParser::LALRParser(const Grammar& g)
+    : analysis_{g} {
+    for (const auto& p : analysis_.productions()) {
+        lhs_.push_back(p.lhs);
+        rhs_.push_back(p.rhs);
+    }
+
+    // S' -> S $, S' gets the first id past the analysed symbols
+    augmented_ = lhs_.size();
+    lhs_.push_back(analysis_.symbol_count());
+    rhs_.push_back({ analysis_.start(), analysis_.end_marker() });
+
+    for (size_t p = 0; p < rhs_.size(); ++p) {
+        item_offset_.push_back(item_production_.size());
+        item_production_.insert(item_production_.end(), rhs_[p].size() + 1, p);
+    }
+
+    cyclic_ = find_cycle();
+    build_lr0();
+    build_tables(lookaheads());
+}
+
+// A =>+ A needs a chain of productions A -> α B β with α and β nullable leading back to A
+inline bool LALRParser::find_cycle() const {
+    const size_t symbols = analysis_.symbol_count();
+    std::vector<std::vector<uint32_t>> edges(symbols);
+
+    for (const auto& p : analysis_.productions()) {
+        size_t not_nullable = 0;
+        for (uint32_t sym : p.rhs) {
+            if (!analysis_.nullable(sym)) ++not_nullable;
+        }
+
+        for (uint32_t sym : p.rhs) {
+            if (analysis_.is_terminal(sym)) continue;
+            if (not_nullable == 0 || (not_nullable == 1 && !analysis_.nullable(sym))) {
+                edges[p.lhs].push_back(sym);
+            }
+        }
+    }
+
+    // 0 unseen, 1 on the dfs path, 2 done
+    std::vector<uint8_t> color(symbols, 0);
+    auto dfs = [&](auto&& self, uint32_t a) -> bool {
+        color[a] = 1;
+        for (uint32_t b : edges[a]) {
+            if (color[b] == 1) return true;
+            if (color[b] == 0 && self(self, b)) return true;
+        }
+        color[a] = 2;
+        return false;
+    };
+
+    for (uint32_t a = analysis_.end_marker() + 1; a < symbols; ++a) {
+        if (color[a] == 0 && dfs(dfs, a)) return true;
+    }
+    return false;
+}
+
+inline void LALRParser::build_lr0() {
+    const size_t symbols = analysis_.symbol_count() + 1;
+
+    std::map<std::vector<uint32_t>, uint32_t> state_of;
+    std::vector<uint32_t> predicted(symbols, UINT32_MAX);
+    std::vector<std::vector<uint32_t>> by_symbol(symbols);
+
+    kernels_.push_back({ item_offset_[augmented_] });
+    state_of.emplace(kernels_[0], 0);
+
+    for (uint32_t s = 0; s < kernels_.size(); ++s) {
+        std::vector<uint32_t> closure = kernels_[s];
+
+        for (size_t i = 0; i < closure.size(); ++i) {
+            const uint32_t item = closure[i];
+            const uint32_t p = item_production_[item];
+            const uint32_t dot = item - item_offset_[p];
+            if (dot == rhs_[p].size()) continue;
+
+            const uint32_t next = rhs_[p][dot];
+            if (analysis_.is_terminal(next) || predicted[next] == s) continue;
+
+            predicted[next] = s;
+            for (uint32_t q : analysis_.productions_of(next)) {
+                closure.push_back(item_offset_[q]);
+            }
+        }
+
+        std::vector<uint32_t> touched;
+        reductions_.emplace_back();
+
+        for (uint32_t item : closure) {
+            const uint32_t p = item_production_[item];
+            const uint32_t dot = item - item_offset_[p];
+
+            if (dot == rhs_[p].size()) {
+                if (p != augmented_) reductions_[s].push_back(p);
+                continue;
+            }
+
+            const uint32_t next = rhs_[p][dot];
+            if (by_symbol[next].empty()) touched.push_back(next);
+            by_symbol[next].push_back(item + 1);
+        }
+
+        std::ranges::sort(touched);
+        std::vector<Transition> out;
+
+        for (uint32_t sym : touched) {
+            auto kernel = std::move(by_symbol[sym]);
+            by_symbol[sym].clear();
+            std::ranges::sort(kernel);
+
+            auto [it, inserted] = state_of.try_emplace(kernel, kernels_.size());
+            if (inserted) {
+                kernels_.push_back(std::move(kernel));
+            }
+            out.push_back({ sym, it->second });
+        }
+
+        transitions_.push_back(std::move(out));
+    }
+}
+
+inline uint32_t LALRParser::goto_state(uint32_t state, uint32_t symbol) const {
+    const auto& out = transitions_[state];
+    auto it = std::ranges::lower_bound(out, symbol, {}, &Transition::symbol);
+    return it != out.end() && it->symbol == symbol ? it->target : UINT32_MAX;
+}
+
+inline std::vector<TerminalSet> LALRParser::lookaheads() {
+    const size_t width = analysis_.end_marker() + 1;
+
+    // number the non-terminal transitions
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> nt_transition;
+    std::vector<std::pair<uint32_t, uint32_t>> transition_list;
+
+    for (uint32_t s = 0; s < transitions_.size(); ++s) {
+        for (const auto& t : transitions_[s]) {
+            if (!analysis_.is_terminal(t.symbol)) {
+                nt_transition.emplace(std::make_pair(s, t.symbol), transition_list.size());
+                transition_list.push_back({ s, t.symbol });
+            }
+        }
+    }
+
+    const size_t n = transition_list.size();
+    std::vector<TerminalSet> sets(n, TerminalSet(width));
+    std::vector<std::vector<uint32_t>> reads(n);
+    std::vector<std::vector<uint32_t>> includes(n);
+
+    // DR and reads
+    for (uint32_t x = 0; x < n; ++x) {
+        const auto [p, a] = transition_list[x];
+        const uint32_t r = goto_state(p, a);
+
+        for (const auto& t : transitions_[r]) {
+            if (analysis_.is_terminal(t.symbol)) {
+                sets[x].insert(t.symbol);
+            } else if (analysis_.nullable(t.symbol)) {
+                reads[x].push_back(nt_transition.at({ r, t.symbol }));
+            }
+        }
+    }
+
+    // includes and lookback, both found by walking each production from each transition on its lhs
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<uint32_t>> lookback;
+
+    for (uint32_t x = 0; x < n; ++x) {
+        const auto [p_start, b] = transition_list[x];
+
+        for (uint32_t prod : analysis_.productions_of(b)) {
+            const auto& rhs = rhs_[prod];
+            uint32_t state = p_start;
+
+            for (size_t i = 0; i < rhs.size(); ++i) {
+                if (!analysis_.is_terminal(rhs[i])) {
+                    bool rest_nullable = true;
+                    for (size_t j = i + 1; j < rhs.size() && rest_nullable; ++j) {
+                        rest_nullable = analysis_.nullable(rhs[j]);
+                    }
+                    if (rest_nullable) {
+                        includes[nt_transition.at({ state, rhs[i] })].push_back(x);
+                    }
+                }
+                state = goto_state(state, rhs[i]);
+            }
+
+            lookback[{ state, prod }].push_back(x);
+        }
+    }
+
+    // digraph: F(x) = F'(x) ∪ ⋃ { F(y) | x R y }, one strongly connected component at a time
+    auto digraph = [&](const std::vector<std::vector<uint32_t>>& relation) {
+        std::vector<uint32_t> depth(n, 0);
+        std::vector<uint32_t> stack;
+
+        auto traverse = [&](auto&& self, uint32_t x) -> void {
+            stack.push_back(x);
+            const uint32_t d = stack.size();
+            depth[x] = d;
+
+            for (uint32_t y : relation[x]) {
+                if (depth[y] == 0) self(self, y);
+                depth[x] = std::min(depth[x], depth[y]);
+                sets[x].merge(sets[y]);
+            }
+
+            if (depth[x] == d) {
+                while (true) {
+                    const uint32_t top = stack.back();
+                    stack.pop_back();
+                    depth[top] = UINT32_MAX;
+                    if (top == x) break;
+                    sets[top] = sets[x];
+                }
+            }
+        };
+
+        for (uint32_t x = 0; x < n; ++x) {
+            if (depth[x] == 0) traverse(traverse, x);
+        }
+    };
+
+    digraph(reads);
+    digraph(includes);
+
+    // lookahead per (state, reduction), laid out like reductions_
+    std::vector<TerminalSet> out;
+    for (uint32_t s = 0; s < reductions_.size(); ++s) {
+        for (uint32_t prod : reductions_[s]) {
+            TerminalSet la(width);
+            auto it = lookback.find({ s, prod });
+            if (it != lookback.end()) {
+                for (uint32_t x : it->second) la.merge(sets[x]);
+            }
+            out.push_back(std::move(la));
+        }
+    }
+    return out;
+}
+
+inline void LALRParser::build_tables(const std::vector<TerminalSet>& lookahead) {
+    const size_t width = analysis_.end_marker() + 1;
+    const size_t states = kernels_.size();
+
+    std::vector<PackedTable::Row> action_rows(states);
+    std::vector<PackedTable::Row> goto_rows(states);
+    default_reduction_.assign(states, ERROR);
+
+    std::vector<int32_t> row(width);
+    size_t next_lookahead = 0;
+
+    for (uint32_t s = 0; s < states; ++s) {
+        std::ranges::fill(row, ERROR);
+
+        for (const auto& t : transitions_[s]) {
+            if (t.symbol == analysis_.end_marker()) {
+                row[t.symbol] = ACCEPT;
+            } else if (analysis_.is_terminal(t.symbol)) {
+                row[t.symbol] = static_cast<int32_t>(t.target) + 1;
+            } else {
+                goto_rows[s].push_back({ analysis_.non_terminal_index(t.symbol), static_cast<int32_t>(t.target) });
+            }
+        }
+
+        // reductions in production order, so the earlier production is the one kept
+        std::vector<std::pair<uint32_t, const TerminalSet*>> reduces;
+        for (uint32_t prod : reductions_[s]) {
+            reduces.push_back({ prod, &lookahead[next_lookahead++] });
+        }
+        std::ranges::sort(reduces, {}, &std::pair<uint32_t, const TerminalSet*>::first);
+
+        std::map<uint32_t, LALRConflict> found;
+
+        for (const auto& [prod, la] : reduces) {
+            la->for_each([&](uint32_t t) {
+                const int32_t reduce = -static_cast<int32_t>(prod) - 1;
+
+                if (row[t] == ERROR) {
+                    row[t] = reduce;
+                    return;
+                }
+
+                auto [it, inserted] = found.try_emplace(t);
+                auto& conflict = it->second;
+                if (inserted) {
+                    const bool shift = row[t] > 0 || row[t] == ACCEPT;
+                    conflict = { LALRConflict::Kind::ShiftReduce, s, analysis_.name(t), shift, {} };
+                    if (!shift) conflict.productions.push_back(-row[t] - 1);
+                }
+                conflict.productions.push_back(prod);
+            });
+        }
+
+        for (auto& [_, conflict] : found) {
+            if (conflict.productions.size() > 1) {
+                conflict.kind = LALRConflict::Kind::ReduceReduce;
+            }
+            conflicts_.push_back(std::move(conflict));
+        }
+
+        // the most frequent reduction becomes the default of the row
+        std::map<int32_t, size_t> frequency;
+        for (int32_t v : row) {
+            if (v < 0 && v != ACCEPT) ++frequency[v];
+        }
+        if (!frequency.empty()) {
+            default_reduction_[s] = std::ranges::max_element(frequency, {}, &std::pair<const int32_t, size_t>::second)->first;
+        }
+
+        for (uint32_t t = 0; t < width; ++t) {
+            if (row[t] != ERROR && row[t] != default_reduction_[s]) {
+                action_rows[s].push_back({ t, row[t] });
+            }
+        }
+    }
+
+    action_.pack(action_rows);
+    goto_.pack(goto_rows);
+}
+
+inline bool LALRParser::run(
+    const std::vector<Grammar::Symbol>& tokens,
+    std::vector<size_t>* out,
+    std::string* error
+) const {
+    if (cyclic_) {
+        throw std::runtime_error("Grammar is cyclic, a non-terminal derives itself");
+    }
+    if (std::ranges::any_of(conflicts_, [](const auto& c) { return c.kind == LALRConflict::Kind::ReduceReduce; })) {
+        throw std::runtime_error("Grammar has reduce/reduce conflicts");
+    }
+
+    const uint32_t end = analysis_.end_marker();
+
+    auto fail = [&](size_t pos, const std::string& what) {
+        if (error) {
+            *error = what + " at position " + std::to_string(pos);
+        }
+        return false;
+    };
+
+    // a conflict-free table always halts
+    const size_t max_growth = conflicts_.empty()
+        ? SIZE_MAX
+        : kernels_.size() * (analysis_.non_terminal_count() + 1);
+
+    std::vector<uint32_t> stack = { 0 };
+    size_t shifted_height = stack.size();
+    size_t pos = 0;
+    uint32_t t = UINT32_MAX;
+
+    while (true) {
+        if (t == UINT32_MAX) {
+            if (pos == tokens.size()) {
+                t = end;
+            } else {
+                t = analysis_.id_of(tokens[pos]);
+                if (t == GrammarAnalysis::NONE || !analysis_.is_terminal(t)) {
+                    return fail(pos, "Unknown token '" + tokens[pos] + "'");
+                }
+            }
+        }
+
+        const uint32_t s = stack.back();
+        const int32_t act = action_.get(s, t, default_reduction_[s]);
+
+        if (act == ACCEPT) {
+            return true;
+        }
+
+        if (act > 0) {
+            stack.push_back(act - 1);
+            shifted_height = stack.size();
+            ++pos;
+            t = UINT32_MAX;
+            continue;
+        }
+
+        if (act == ERROR) {
+            return fail(pos, "Unexpected '" + analysis_.name(t) + "'");
+        }
+
+        const size_t prod = -act - 1;
+        stack.resize(stack.size() - rhs_[prod].size());
+        stack.push_back(goto_.get(stack.back(), analysis_.non_terminal_index(lhs_[prod]), 0));
+
+        if (stack.size() > shifted_height && stack.size() - shifted_height > max_growth) {
+            throw std::runtime_error("Parse does not terminate, ε-reductions keep growing the stack at position " +
+                                     std::to_string(pos));
+        }
+
+        if (out) {
+            out->push_back(prod);
+        }
+    }
+}
+
+inline std::vector<size_t> LALRParser::parse(const std::vector<Grammar::Symbol>& tokens) const {
+    std::vector<size_t> out;
+    std::string error;
+
+    if (!run(tokens, &out, &error)) {
+        throw std::runtime_error(error);
+    }
+    return out;
+}
+
+inline void LALRParser::print_conflicts(std::ostream& os) const {
+    for (const auto& conflict : conflicts_) {
+        os << (conflict.kind == LALRConflict::Kind::ShiftReduce ? "Shift/reduce" : "Reduce/reduce")
+           << " conflict in state " << conflict.state << " on " << conflict.lookahead << ":\n";
+        if (conflict.shift && conflict.kind == LALRConflict::Kind::ReduceReduce) {
+            os << "  shift " << conflict.lookahead << '\n';
+        }
+        for (size_t p : conflict.productions) {
+            os << "  " << analysis_.production_to_string(p) << '\n';
+        }
+    }
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "cyk.hpp"
+
+// Counts, lists and samples the words of a CNF grammar by length.
+//
+// The tables are filled like a CYK chart without an input: trees(A, n) is the number
+// of parse trees of A with yield length n,
+//
+//   trees(A, 1) = #{ A -> t }
+//   trees(A, n) = sum over A -> B C and 0 < k < n of trees(B, k) * trees(C, n - k)
+//
+// Tree counts are 64-bit and saturate; trees_overflowed(n) says whether tree_count(n)
+// is exact. They match the number of words only for unambiguous grammars, and
+// sample_tree() is uniform over parse trees, which is cheap at any length.
+//
+// Counting distinct words has no such recurrence for ambiguous grammars, so
+// word_count(), enumerate() and sample_word() go through the deduplicated word sets
+// instead. Those are exact but grow with the language, so keep their lengths small.
+
+class LanguageCounter {
+public:
+    LanguageCounter(const Grammar& cnf, size_t max_length);
+
+    uint64_t tree_count(size_t length) const { return count_of(grammar_.start, length); }
+    bool trees_overflowed(size_t length) const;
+
+    uint64_t word_count(size_t length) const { return words_at(length).size(); }
+
+    // distinct words of exactly this length, sorted
+    std::vector<std::string> enumerate(size_t length) const { return words_at(length); }
+    // distinct words up to this length, shortest first
+    std::vector<std::string> enumerate_up_to(size_t max_length) const;
+
+    // uniform over parse trees of this length
+    std::optional<std::string> sample_tree(size_t length, std::mt19937_64& rng) const;
+    // uniform over distinct words of this length
+    std::optional<std::string> sample_word(size_t length, std::mt19937_64& rng) const;
+
+private:
+    static constexpr uint64_t SATURATED = UINT64_MAX;
+
+    struct Rule {
+        uint32_t left;
+        uint32_t right;
+    };
+
+    void check_length(size_t length) const {
+        if (length > max_length_) {
+            throw std::runtime_error("Length " + std::to_string(length) + " is past the counted range");
+        }
+    }
+
+    uint64_t count_of(uint32_t nt, size_t length) const {
+        check_length(length);
+        if (length == 0) {
+            return nt == grammar_.start && grammar_.accepts_empty ? 1 : 0;
+        }
+        return counts_[length * nts_ + nt];
+    }
+
+    const std::vector<std::string>& words_of(uint32_t nt, size_t length) const;
+    const std::vector<std::string>& words_at(size_t length) const;
+    void sample_into(uint32_t nt, size_t length, std::mt19937_64& rng, std::string& out) const;
+
+    CompiledCNF grammar_;
+    size_t max_length_;
+    size_t nts_;
+
+    std::vector<std::vector<Rule>> rules_by_lhs_;
+    std::vector<std::vector<Grammar::Symbol>> terminals_by_lhs_;
+
+    std::vector<uint64_t> counts_;
+    // the same counts as floating point, for weighting choices once the exact ones saturate
+    std::vector<long double> weights_;
+
+    mutable std::map<std::pair<uint32_t, size_t>, std::vector<std::string>> words_;
+};
+
+inline LanguageCounter::LanguageCounter(const Grammar& cnf, size_t max_length)
+    : grammar_{cnf},
+      max_length_{max_length},
+      nts_{grammar_.non_terminals.size()},
+      rules_by_lhs_(nts_),
+      terminals_by_lhs_(nts_),
+      counts_((max_length + 1) * nts_, 0),
+      weights_((max_length + 1) * nts_, 0) {
+    for (uint32_t b = 0; b < nts_; ++b) {
+        for (const auto& rule : grammar_.binary_rules[b]) {
+            rules_by_lhs_[rule.lhs].push_back({ b, rule.right });
+        }
+    }
+
+    for (const auto& [terminal, lhses] : grammar_.terminal_rules) {
+        for (uint32_t a : lhses) {
+            terminals_by_lhs_[a].push_back(terminal);
+        }
+    }
+
+    for (auto& terminals : terminals_by_lhs_) {
+        std::ranges::sort(terminals);
+    }
+
+    if (max_length == 0) {
+        return;
+    }
+
+    for (uint32_t a = 0; a < nts_; ++a) {
+        counts_[nts_ + a] = terminals_by_lhs_[a].size();
+        weights_[nts_ + a] = terminals_by_lhs_[a].size();
+    }
+
+    for (size_t n = 2; n <= max_length; ++n) {
+        for (uint32_t a = 0; a < nts_; ++a) {
+            uint64_t total = 0;
+            long double weight = 0;
+
+            for (const auto& rule : rules_by_lhs_[a]) {
+                for (size_t k = 1; k < n; ++k) {
+                    uint64_t product;
+                    const uint64_t left = counts_[k * nts_ + rule.left];
+                    const uint64_t right = counts_[(n - k) * nts_ + rule.right];
+
+                    if (left == SATURATED || right == SATURATED ||
+                        __builtin_mul_overflow(left, right, &product) ||
+                        __builtin_add_overflow(total, product, &total)) {
+                        total = SATURATED;
+                    }
+
+                    weight += weights_[k * nts_ + rule.left] * weights_[(n - k) * nts_ + rule.right];
+                }
+            }
+
+            counts_[n * nts_ + a] = total;
+            weights_[n * nts_ + a] = weight;
+        }
+    }
+}
+
+inline bool LanguageCounter::trees_overflowed(size_t length) const {
+    return tree_count(length) == SATURATED;
+}
+
+inline const std::vector<std::string>& LanguageCounter::words_of(uint32_t nt, size_t length) const {
+    auto key = std::make_pair(nt, length);
+    if (auto it = words_.find(key); it != words_.end()) {
+        return it->second;
+    }
+
+    std::vector<std::string> out;
+
+    if (length == 1) {
+        out = terminals_by_lhs_[nt];
+    } else {
+        for (const auto& rule : rules_by_lhs_[nt]) {
+            for (size_t k = 1; k < length; ++k) {
+                if (counts_[k * nts_ + rule.left] == 0 || counts_[(length - k) * nts_ + rule.right] == 0) {
+                    continue;
+                }
+
+                // words_ is a std::map, so building the right side keeps this valid
+                const std::vector<std::string>& left = words_of(rule.left, k);
+                const std::vector<std::string>& right = words_of(rule.right, length - k);
+
+                for (const auto& l : left) {
+                    for (const auto& r : right) {
+                        out.push_back(l + r);
+                    }
+                }
+            }
+        }
+
+        std::ranges::sort(out);
+        auto [first, last] = std::ranges::unique(out);
+        out.erase(first, last);
+    }
+
+    return words_.emplace(key, std::move(out)).first->second;
+}
+
+inline const std::vector<std::string>& LanguageCounter::words_at(size_t length) const {
+    static const std::vector<std::string> none;
+    static const std::vector<std::string> empty_word{ "" };
+
+    check_length(length);
+
+    if (length == 0) {
+        return grammar_.accepts_empty ? empty_word : none;
+    }
+
+    if (count_of(grammar_.start, length) == 0) {
+        return none;
+    }
+
+    return words_of(grammar_.start, length);
+}
+
+inline std::vector<std::string> LanguageCounter::enumerate_up_to(size_t max_length) const {
+    std::vector<std::string> out;
+    for (size_t n = 0; n <= max_length; ++n) {
+        const auto& words = words_at(n);
+        out.insert(out.end(), words.begin(), words.end());
+    }
+    return out;
+}
+
+inline void LanguageCounter::sample_into(
+    uint32_t nt,
+    size_t length,
+    std::mt19937_64& rng,
+    std::string& out
+) const {
+    if (length == 1) {
+        const auto& terminals = terminals_by_lhs_[nt];
+        std::uniform_int_distribution<size_t> dist(0, terminals.size() - 1);
+        out += terminals[dist(rng)];
+        return;
+    }
+
+    std::uniform_real_distribution<long double> dist(0, weights_[length * nts_ + nt]);
+    long double pick = dist(rng);
+
+    const Rule* chosen = nullptr;
+    size_t split = 0;
+
+    for (const auto& rule : rules_by_lhs_[nt]) {
+        for (size_t k = 1; k < length && pick >= 0; ++k) {
+            long double w = weights_[k * nts_ + rule.left] * weights_[(length - k) * nts_ + rule.right];
+            if (w == 0) continue;
+
+            // keeping the last candidate covers rounding at the top of the range
+            chosen = &rule;
+            split = k;
+            pick -= w;
+        }
+    }
+
+    sample_into(chosen->left, split, rng, out);
+    sample_into(chosen->right, length - split, rng, out);
+}
+
+inline std::optional<std::string> LanguageCounter::sample_tree(size_t length, std::mt19937_64& rng) const {
+    check_length(length);
+
+    if (length == 0) {
+        return grammar_.accepts_empty ? std::optional<std::string>{ "" } : std::nullopt;
+    }
+
+    if (weights_[length * nts_ + grammar_.start] == 0) {
+        return std::nullopt;
+    }
+
+    std::string out;
+    sample_into(grammar_.start, length, rng, out);
+    return out;
+}
+
+inline std::optional<std::string> LanguageCounter::sample_word(size_t length, std::mt19937_64& rng) const {
+    const auto& words = words_at(length);
+    if (words.empty()) {
+        return std::nullopt;
+    }
+
+    std::uniform_int_distribution<size_t> dist(0, words.size() - 1);
+    return words[dist(rng)];
+}
@@ -1,12 +1,15 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <optional>
-#include <regex>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "file_stream.hpp"
+#include "mapped_file.hpp"
+#include "regex_set.hpp"
 
-enum class TokenType {
+enum class TokenType : uint8_t {
     Identifier,
     Equals,
     LParen,
@@ -22,51 +25,113 @@ enum class TokenType {
     End
 };
 
+// 12 bytes and nothing on the heap: the text of a token is the range [offset,
+// offset + length) of the source, a string literal's without its quotes, and the line
+// and column come from Lexer::position()
 struct Token {
     TokenType type;
-    std::optional<std::string> lexeme;
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SourcePosition {
     size_t line;
     size_t column;
 };
 
+// pattern is in the usual regex syntax, as far as the rules below use it: literals,
+// escapes, [classes], ., |, *, +, ?, groups, and \b at the very end
 struct Rule {
     TokenType type;
-    std::regex pattern;
+    std::string_view pattern;
     bool skip;
 };
 
+// The rules are compiled into a single DFA (a RegexScanner) the first time a lexer is
+// made, and all lexers share it. Every token is one run of it from the current
+// position: the longest match wins, and of the rules matching that much the first one,
+// so "return" is a Return and "returned" an Identifier. That is what \b after a keyword
+// asks for, so it needs no work of its own.
+//
+// Tokens are pulled one at a time with next_token(), so a parser can start before the
+// end of the file is lexed, and nothing but the source grows with it. Given a
+// MappedFile the lexer reads the mapping in place and the source is not copied either;
+// the file has to outlive the lexer then. Given a FileStream, which has to outlive it
+// too, the lexer reads the next chunk whenever a token might go on past what it has
+// read, and scans that token again; what was read stays in owned_, so lexemes and
+// positions of earlier tokens stay valid.
 class Lexer {
 public:
-    explicit Lexer(std::string src)
-    : src_{std::move(src)} {}
+    explicit Lexer(std::string src);
+    explicit Lexer(const MappedFile& file);
+    explicit Lexer(FileStream& stream);
+
+    // src_ may point into owned_
+    Lexer(const Lexer&) = delete;
+    Lexer& operator=(const Lexer&) = delete;
 
+    // the next token, and once the source is used up a NewLine and then End for good
+    Token next_token();
+    // back to the start of the source
+    void rewind();
+
+    // every token from the start, up to and including End
     std::vector<Token> lex();
+    // the same into a buffer of the caller's, which is cleared first and can be reused
+    void lex(std::vector<Token>& out);
+
+    std::string_view lexeme(const Token& token) const {
+        return src_.substr(token.offset, token.length);
+    }
+    // 1-based; a string literal is where its opening quote is
+    SourcePosition position(const Token& token) const {
+        return position_of(token.offset - (token.type == TokenType::StringLiteral ? 1 : 0));
+    }
+
     const char* token_to_str(TokenType t) const;
-    void debug_log(const std::vector<Token>& tokens);
+    void debug_log(const Token& token) const;
+    void debug_log(const std::vector<Token>& tokens) const;
 
 private:
-    void advance_position(const std::string& lexeme);
-    Token make_token(TokenType type, std::optional<std::string> lexeme, size_t line, size_t column) const;
+    // a place in the source and the line it is on
+    struct Cursor {
+        size_t offset = 0;
+        size_t line = 1;
+        size_t line_start = 0;
+    };
+
+    // built on first use, then read-only
+    static const RegexScanner& scanner();
 
-    std::vector<Token> out_;
-    const std::string src_;
-    size_t col_ = 1;
-    size_t line_ = 1;
+    SourcePosition position_of(size_t offset) const;
+    // appends the next chunk of stream_ to the source, false if there is none
+    bool refill();
+
+    std::string owned_;
+    std::string_view src_;
+    // null once the stream is used up, or without one
+    FileStream* stream_ = nullptr;
     size_t idx_ = 0;
+    bool at_end_ = false;
+    // where the last position was asked for: positions are counted from there, so
+    // asking for them in order, as debug_log() and the parser do, is one pass in all
+    mutable Cursor cursor_;
 
-    const std::vector<Rule> rules_ = {
-        {TokenType::NewLine, std::regex(R"(\n)"), false},
-        {TokenType::End, std::regex(R"([ \t\r]+)"), true},
-        {TokenType::Return, std::regex(R"(return\b)"), false},
-        {TokenType::Type, std::regex(R"(VecF64\b)"), false},
-        {TokenType::Float, std::regex(R"([0-9]+\.[0-9]+)"), false},
-        {TokenType::Integer, std::regex(R"([0-9]+)"), false},
-        {TokenType::StringLiteral, std::regex(R"("([^"\\]|\\.)*")"), false},
-        {TokenType::Identifier, std::regex(R"([A-Za-z_][A-Za-z0-9_]*)"), false},
-        {TokenType::Equals, std::regex(R"(=)"), false},
-        {TokenType::LParen, std::regex(R"(\()"), false},
-        {TokenType::RParen, std::regex(R"(\))"), false},
-        {TokenType::Comma, std::regex(R"(,)"), false},
-        {TokenType::Colon, std::regex(R"(:)"), false},
+    static constexpr Rule rules_[] = {
+        {TokenType::NewLine, R"(\n)", false},
+        {TokenType::End, R"([ \t\r]+)", true},
+        {TokenType::Return, R"(return\b)", false},
+        {TokenType::Type, R"(VecF64\b)", false},
+        {TokenType::Float, R"([0-9]+\.[0-9]+)", false},
+        {TokenType::Integer, R"([0-9]+)", false},
+        {TokenType::StringLiteral, R"("([^"\\]|\\.)*")", false},
+        {TokenType::Identifier, R"([A-Za-z_][A-Za-z0-9_]*)", false},
+        {TokenType::Equals, R"(=)", false},
+        {TokenType::LParen, R"(\()", false},
+        {TokenType::RParen, R"(\))", false},
+        {TokenType::Comma, R"(,)", false},
+        {TokenType::Colon, R"(:)", false},
     };
+
+    const RegexScanner& scanner_ = scanner();
 };
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "grammar_analysis.hpp"
+
+// Table-driven LL(1) parser generated from a Grammar.
+//
+// Production A -> α goes into table[A][t] for every t in FIRST(α), and for every t in
+// FOLLOW(A) as well when α is nullable. A cell that gets more than one production is a
+// conflict; the conflicts are collected instead of thrown so the whole table can be
+// inspected, and parsing with a conflicting table is refused (a left recursive choice
+// would never stop expanding).
+//
+// Parsing is a loop over an explicit symbol stack, no recursion, and produces the left
+// parse: the productions of the leftmost derivation in the order they are applied.
+
+struct LL1Conflict {
+    Grammar::Symbol non_terminal;
+    Grammar::Symbol lookahead;
+    std::vector<size_t> productions;
+};
+
+class LL1Parser {
+public:
+    explicit LL1Parser(const Grammar& g);
+
+    bool is_ll1() const { return conflicts_.empty(); }
+    const std::vector<LL1Conflict>& conflicts() const { return conflicts_; }
+
+    const GrammarAnalysis& analysis() const { return analysis_; }
+
+    bool recognize(const std::vector<Grammar::Symbol>& tokens) const {
+        return run(tokens, nullptr, nullptr);
+    }
+    bool recognize(const std::string& input) const {
+        return recognize(to_symbols(input));
+    }
+
+    // left parse, throws on a syntax error
+    std::vector<size_t> parse(const std::vector<Grammar::Symbol>& tokens) const;
+    std::vector<size_t> parse(const std::string& input) const {
+        return parse(to_symbols(input));
+    }
+
+    void print_table(std::ostream& os = std::cout) const;
+    void print_conflicts(std::ostream& os = std::cout) const;
+
+private:
+    static constexpr int32_t EMPTY = -1;
+
+    int32_t cell(uint32_t nt, uint32_t lookahead) const {
+        return table_[analysis_.non_terminal_index(nt) * width_ + lookahead];
+    }
+
+    bool run(const std::vector<Grammar::Symbol>& tokens, std::vector<size_t>* out, std::string* error) const;
+
+    GrammarAnalysis analysis_;
+    // terminals plus the end marker
+    size_t width_;
+    std::vector<int32_t> table_;
+    std::vector<LL1Conflict> conflicts_;
+};
+
+inline LL1Parser::LL1Parser(const Grammar& g)
+    : analysis_{g},
+      width_{analysis_.end_marker() + size_t{1}},
+      table_(analysis_.non_terminal_count() * width_, EMPTY) {
+    const auto& productions = analysis_.productions();
+
+    // every production a cell would get, to report all of them on a conflict
+    std::vector<std::vector<size_t>> candidates(table_.size());
+
+    for (size_t p = 0; p < productions.size(); ++p) {
+        const auto& rhs = productions[p].rhs;
+        const size_t row = analysis_.non_terminal_index(productions[p].lhs) * width_;
+
+        TerminalSet lookahead(width_);
+        if (analysis_.first_of(rhs.data(), rhs.data() + rhs.size(), lookahead)) {
+            lookahead.merge(analysis_.follow(productions[p].lhs));
+        }
+
+        lookahead.for_each([&](uint32_t t) {
+            candidates[row + t].push_back(p);
+            if (table_[row + t] == EMPTY) {
+                table_[row + t] = p;
+            }
+        });
+    }
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (candidates[i].size() > 1) {
+            const uint32_t nt = analysis_.end_marker() + 1 + i / width_;
+            conflicts_.push_back({ analysis_.name(nt), analysis_.name(i % width_), std::move(candidates[i]) });
+        }
+    }
+}
+
+inline bool LL1Parser::run(
+    const std::vector<Grammar::Symbol>& tokens,
+    std::vector<size_t>* out,
+    std::string* error
+) const {
+    if (!is_ll1()) {
+        throw std::runtime_error("Grammar is not LL(1), the parse table has conflicts");
+    }
+
+    const uint32_t end = analysis_.end_marker();
+    const auto& productions = analysis_.productions();
+
+    auto fail = [&](size_t pos, const std::string& what) {
+        if (error) {
+            *error = what + " at position " + std::to_string(pos);
+        }
+        return false;
+    };
+
+    std::vector<uint32_t> stack = { end, analysis_.start() };
+    size_t pos = 0;
+
+    auto lookahead = [&]() {
+        if (pos == tokens.size()) return end;
+        const uint32_t id = analysis_.id_of(tokens[pos]);
+        return id != GrammarAnalysis::NONE && analysis_.is_terminal(id) ? id : GrammarAnalysis::NONE;
+    };
+
+    while (true) {
+        const uint32_t top = stack.back();
+        const uint32_t t = lookahead();
+
+        if (t == GrammarAnalysis::NONE) {
+            return fail(pos, "Unknown token '" + tokens[pos] + "'");
+        }
+
+        if (analysis_.is_terminal(top)) {
+            if (top != t) {
+                return fail(pos, "Expected '" + analysis_.name(top) + "', got '" + analysis_.name(t) + "'");
+            }
+            if (top == end) {
+                return true;
+            }
+
+            stack.pop_back();
+            ++pos;
+            continue;
+        }
+
+        const int32_t p = cell(top, t);
+        if (p == EMPTY) {
+            return fail(pos, "Unexpected '" + analysis_.name(t) + "' while parsing " + analysis_.name(top));
+        }
+
+        if (out) {
+            out->push_back(p);
+        }
+
+        stack.pop_back();
+        const auto& rhs = productions[p].rhs;
+        stack.insert(stack.end(), rhs.rbegin(), rhs.rend());
+    }
+}
+
+inline std::vector<size_t> LL1Parser::parse(const std::vector<Grammar::Symbol>& tokens) const {
+    std::vector<size_t> out;
+    std::string error;
+
+    if (!run(tokens, &out, &error)) {
+        throw std::runtime_error(error);
+    }
+    return out;
+}
+
+inline void LL1Parser::print_table(std::ostream& os) const {
+    for (uint32_t nt = analysis_.end_marker() + 1; nt < analysis_.symbol_count(); ++nt) {
+        for (uint32_t t = 0; t < width_; ++t) {
+            const int32_t p = cell(nt, t);
+            if (p != EMPTY) {
+                os << "M[" << analysis_.name(nt) << ", " << analysis_.name(t) << "] = "
+                   << analysis_.production_to_string(p) << '\n';
+            }
+        }
+    }
+}
+
+inline void LL1Parser::print_conflicts(std::ostream& os) const {
+    for (const auto& conflict : conflicts_) {
+        os << "Conflict on M[" << conflict.non_terminal << ", " << conflict.lookahead << "]:\n";
+        for (size_t p : conflict.productions) {
+            os << "  " << analysis_.production_to_string(p) << '\n';
+        }
+    }
+}
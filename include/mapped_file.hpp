@@ -0,0 +1,68 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Read-only mmap of a whole regular file. The mapping lives as long as the object.
+// Anything else (a pipe, a FIFO, /dev/stdin) has no size to map and is refused; read
+// those with a FileStream.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const {
+        return { static_cast<const char*>(data_), size_ };
+    }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+inline MappedFile::MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Could not open file: " + path);
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) == -1) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat file: " + path);
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        ::close(fd);
+        throw std::runtime_error("Not a regular file: " + path);
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+
+    // mmap refuses empty mappings, an empty view is all we need then
+    if (size_ != 0) {
+        data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data_ == MAP_FAILED) {
+            data_ = nullptr;
+            ::close(fd);
+            throw std::runtime_error("Could not map file: " + path);
+        }
+    }
+
+    ::close(fd);
+}
+
+inline MappedFile::~MappedFile() {
+    if (data_) {
+        ::munmap(data_, size_);
+    }
+}
@@ -1,23 +1,28 @@
 #pragma once
 
+#include <deque>
 #include <memory>
-#include <vector>
 
 #include "ast.hpp"
 #include "lexer.hpp"
 
+// Pulls its tokens from the lexer as it goes, never holding more than the two it looks
+// ahead at; the lexer also gives their text and positions, and has to outlive the parser.
 class Parser {
 public:
-    explicit Parser(std::vector<Token> tokens)
-    : tokens_(std::move(tokens)) {}
+    explicit Parser(Lexer& lexer)
+    : lexer_(lexer) {}
 
     std::unique_ptr<Program> parse();
 
 private:
-    const Token& peek(size_t offset = 0) const;
-    bool check(TokenType type, size_t offset = 0) const;
+    const Token& peek(size_t offset = 0);
+    bool check(TokenType type, size_t offset = 0);
     bool match(TokenType type);
-    const Token& consume(TokenType type, const std::string& message);
+    Token consume(TokenType type, const std::string& message);
+    std::string text(const Token& token) const {
+        return std::string(lexer_.lexeme(token));
+    }
 
     std::unique_ptr<Statement> statement();
     std::unique_ptr<TypeDeclarationStmt> type_declaration();
@@ -29,6 +34,7 @@ private:
     void consume_statement_terminator();
     [[noreturn]] void error_here(const Token& token, const std::string& message) const;
 
-    std::vector<Token> tokens_;
-    size_t pos_ = 0;
+    Lexer& lexer_;
+    // pulled from the lexer, not consumed yet
+    std::deque<Token> lookahead_;
 };
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cnf_grammar.hpp"
+
+// Inside and Viterbi CYK over a weighted grammar in Chomsky normal form.
+//
+// A chart cell is a dense float array indexed by non-terminal id. Cells are stored
+// row by row, one row per span length, so only the n(n+1)/2 cells of the triangle
+// take up space. Binary rules are kept as parallel arrays sorted by lhs;
+// for every split the combination step is one branch-free pass over those arrays,
+//
+//   acc[r] = max(acc[r], log w[r] + L[left[r]] + R[right[r]])        (Viterbi)
+//   acc[r] += w[r] * L[left[r]] * R[right[r]] * f                    (inside)
+//
+// with no branches in the loop body, and the per-rule accumulators are folded into
+// their lhs once all splits are done.
+//
+// Viterbi scores live in log space. Inside scores are plain floats scaled so that the
+// largest entry of each cell is 1, with the log of the scale kept per cell; f above
+// brings splits with different scales to a common one. Both return log probabilities,
+// -inf for words outside the language.
+//
+// ChomskyNormalForm keeps inside probabilities intact, so inside() on the normalized
+// grammar matches the original one. It sums over unit chains and ε-subtrees, so
+// viterbi() scores the best CNF tree, which can be more than the best original tree.
+
+class PCFGParser {
+public:
+    explicit PCFGParser(const Grammar& cnf);
+
+    double inside(const std::vector<Grammar::Symbol>& word) const;
+    double inside(const std::string& word) const { return inside(to_symbols(word)); }
+
+    double viterbi(const std::vector<Grammar::Symbol>& word) const;
+    double viterbi(const std::string& word) const { return viterbi(to_symbols(word)); }
+
+private:
+    static constexpr float NEG_INF = -std::numeric_limits<float>::infinity();
+
+    struct TerminalRule {
+        uint32_t lhs;
+        float weight;
+    };
+
+    template<typename Leaf, typename Combine, typename Finish>
+    double run(const std::vector<Grammar::Symbol>& word, float empty, Leaf leaf, Combine combine, Finish finish) const;
+
+    size_t nts_ = 0;
+    uint32_t start_ = 0;
+    double empty_weight_ = 0;
+
+    std::unordered_map<Grammar::Symbol, std::vector<TerminalRule>> terminal_rules_;
+
+    // binary rules, structure of arrays sorted by lhs; rules of A are [lhs_begin_[A], lhs_begin_[A + 1])
+    std::vector<uint32_t> left_;
+    std::vector<uint32_t> right_;
+    std::vector<float> weight_;
+    std::vector<float> log_weight_;
+    std::vector<uint32_t> lhs_begin_;
+};
+
+inline PCFGParser::PCFGParser(const Grammar& cnf) {
+    if (!is_cnf(cnf)) {
+        throw std::runtime_error("PCFG CYK requires a grammar in Chomsky normal form");
+    }
+
+    std::unordered_map<Grammar::Symbol, uint32_t> ids;
+    for (const auto& nt : cnf.non_terminals) {
+        ids.emplace(nt, ids.size());
+    }
+    nts_ = ids.size();
+    start_ = ids.at(cnf.start_symbol);
+
+    struct Binary {
+        uint32_t lhs, left, right;
+        double weight;
+    };
+    std::vector<Binary> binary;
+
+    for (const auto& [lhs, rhses] : cnf.productions) {
+        const uint32_t a = ids.at(lhs);
+        auto wit = cnf.weights.find(lhs);
+        if (wit == cnf.weights.end() || wit->second.size() != rhses.size()) {
+            throw std::runtime_error("PCFG CYK requires a weight for every production");
+        }
+        const auto& weights = wit->second;
+
+        for (size_t i = 0; i < rhses.size(); ++i) {
+            const auto& rhs = rhses[i];
+
+            if (rhs.empty()) {
+                empty_weight_ += weights[i];
+            } else if (rhs.size() == 1) {
+                terminal_rules_[rhs[0]].push_back({ a, static_cast<float>(weights[i]) });
+            } else {
+                binary.push_back({ a, ids.at(rhs[0]), ids.at(rhs[1]), weights[i] });
+            }
+        }
+    }
+
+    std::ranges::sort(binary, {}, &Binary::lhs);
+
+    lhs_begin_.assign(nts_ + 1, 0);
+    for (const auto& rule : binary) {
+        left_.push_back(rule.left);
+        right_.push_back(rule.right);
+        weight_.push_back(static_cast<float>(rule.weight));
+        log_weight_.push_back(static_cast<float>(std::log(rule.weight)));
+        ++lhs_begin_[rule.lhs + 1];
+    }
+    for (size_t a = 0; a < nts_; ++a) {
+        lhs_begin_[a + 1] += lhs_begin_[a];
+    }
+}
+
+// shared chart walk: leaf fills a length-1 cell, combine folds one split into the
+// per-rule accumulators, finish turns the accumulators into the cell and reports
+// whether anything derives the span
+template<typename Leaf, typename Combine, typename Finish>
+inline double PCFGParser::run(
+    const std::vector<Grammar::Symbol>& word,
+    float empty,
+    Leaf leaf,
+    Combine combine,
+    Finish finish
+) const {
+    const size_t n = word.size();
+    const size_t rules = left_.size();
+
+    const size_t cells = n * (n + 1) / 2;
+
+    std::vector<float> chart(cells * nts_, empty);
+    std::vector<double> scale(cells, 0);
+    std::vector<uint8_t> live(cells, 0);
+    std::vector<float> acc(rules);
+
+    // rows before len hold n, n - 1, ..., n - len + 2 cells
+    auto cell = [&](size_t i, size_t len) { return (len - 1) * (n + 1) - (len - 1) * len / 2 + i; };
+
+    for (size_t i = 0; i < n; ++i) {
+        const size_t c = cell(i, 1);
+        auto it = terminal_rules_.find(word[i]);
+        if (it != terminal_rules_.end()) {
+            live[c] = leaf(it->second, &chart[c * nts_], scale[c]);
+        }
+    }
+
+    for (size_t len = 2; len <= n; ++len) {
+        for (size_t i = 0; i + len <= n; ++i) {
+            const size_t c = cell(i, len);
+            bool any = false;
+
+            for (size_t k = 1; k < len; ++k) {
+                const size_t lc = cell(i, k);
+                const size_t rc = cell(i + k, len - k);
+                if (!live[lc] || !live[rc]) continue;
+
+                if (!any) {
+                    std::fill(acc.begin(), acc.end(), empty);
+                    any = true;
+                }
+                combine(acc.data(), &chart[lc * nts_], &chart[rc * nts_], scale[lc] + scale[rc]);
+            }
+
+            if (any) {
+                live[c] = finish(acc.data(), &chart[c * nts_], scale[c]);
+            }
+        }
+    }
+
+    const size_t top = cell(0, n);
+    if (!live[top] || chart[top * nts_ + start_] == empty) {
+        return NEG_INF;
+    }
+    return scale[top] + (empty == 0 ? std::log(chart[top * nts_ + start_]) : chart[top * nts_ + start_]);
+}
+
+inline double PCFGParser::inside(const std::vector<Grammar::Symbol>& word) const {
+    if (word.empty()) {
+        return empty_weight_ > 0 ? std::log(empty_weight_) : NEG_INF;
+    }
+
+    const float* weight = weight_.data();
+    const uint32_t* left = left_.data();
+    const uint32_t* right = right_.data();
+    const size_t rules = left_.size();
+
+    // split scales relative to the first split, rescaled when a larger one shows up
+    double base = 0;
+    bool have_base = false;
+
+    auto normalize = [&](float* out, double& s) {
+        float top = *std::max_element(out, out + nts_);
+        if (top <= 0) return false;
+
+        const float inv = 1 / top;
+        for (size_t a = 0; a < nts_; ++a) out[a] *= inv;
+        s += std::log(top);
+        return true;
+    };
+
+    auto leaf = [&](const std::vector<TerminalRule>& rules_of, float* out, double& s) {
+        for (const auto& rule : rules_of) out[rule.lhs] += rule.weight;
+        s = 0;
+        return normalize(out, s);
+    };
+
+    auto combine = [&](float* acc, const float* l, const float* r, double s) {
+        if (!have_base) {
+            base = s;
+            have_base = true;
+        } else if (s > base) {
+            const float down = static_cast<float>(std::exp(base - s));
+            for (size_t x = 0; x < rules; ++x) acc[x] *= down;
+            base = s;
+        }
+
+        const float f = static_cast<float>(std::exp(s - base));
+        for (size_t x = 0; x < rules; ++x) {
+            acc[x] += weight[x] * l[left[x]] * r[right[x]] * f;
+        }
+    };
+
+    auto finish = [&](float* acc, float* out, double& s) {
+        for (size_t a = 0; a < nts_; ++a) {
+            float sum = 0;
+            for (uint32_t x = lhs_begin_[a]; x < lhs_begin_[a + 1]; ++x) sum += acc[x];
+            out[a] = sum;
+        }
+
+        s = base;
+        have_base = false;
+        return normalize(out, s);
+    };
+
+    return run(word, 0.0f, leaf, combine, finish);
+}
+
+inline double PCFGParser::viterbi(const std::vector<Grammar::Symbol>& word) const {
+    if (word.empty()) {
+        return empty_weight_ > 0 ? std::log(empty_weight_) : NEG_INF;
+    }
+
+    const float* log_weight = log_weight_.data();
+    const uint32_t* left = left_.data();
+    const uint32_t* right = right_.data();
+    const size_t rules = left_.size();
+
+    auto leaf = [&](const std::vector<TerminalRule>& rules_of, float* out, double&) {
+        for (const auto& rule : rules_of) {
+            out[rule.lhs] = std::max(out[rule.lhs], std::log(rule.weight));
+        }
+        return !rules_of.empty();
+    };
+
+    auto combine = [&](float* acc, const float* l, const float* r, double) {
+        for (size_t x = 0; x < rules; ++x) {
+            acc[x] = std::max(acc[x], log_weight[x] + l[left[x]] + r[right[x]]);
+        }
+    };
+
+    auto finish = [&](float* acc, float* out, double&) {
+        bool any = false;
+        for (size_t a = 0; a < nts_; ++a) {
+            float best = NEG_INF;
+            for (uint32_t x = lhs_begin_[a]; x < lhs_begin_[a + 1]; ++x) best = std::max(best, acc[x]);
+            out[a] = best;
+            any |= best != NEG_INF;
+        }
+        return any;
+    };
+
+    return run(word, NEG_INF, leaf, combine, finish);
+}
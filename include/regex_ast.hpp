@@ -2,69 +2,70 @@
 
 #include "shared.hpp"
 
+#include <charconv>
+#include <cstdint>
+#include <span>
 #include <stdexcept>
+#include <string_view>
 #include <vector>
-#include <variant>
-#include <memory>
 
 // (S|T)(U|V)W*Y+24
 // L(U|N)O^3p*Q(2|3)
 // R*S(T|U|V)W(X|Y|Z)^2
 
-struct LiteralNode;
-struct ConcatNode;
-struct OrNode;
-struct StarNode;
-struct PlusNode;
-struct RepeatNode;
-struct QMarkNode;
-
-using RegexAST = std::variant<
-    LiteralNode,
-    ConcatNode,
-    OrNode,
-    StarNode,
-    PlusNode,
-    RepeatNode,
-    QMarkNode
->;
-
-struct LiteralNode {
-    std::string value;
+enum class RegexNodeType : uint8_t {
+    Literal,
+    Concat,
+    Or,
+    Star,
+    Plus,
+    Repeat,
+    QMark
 };
 
-struct ConcatNode {
-    std::vector<std::unique_ptr<RegexAST>> children;
+struct RegexNode {
+    RegexNodeType type;
+    // Literal: the character
+    char ch = 0;
+    // Star/Plus/QMark/Repeat: the child, Or: the left child, Concat: first entry in RegexAST::children
+    uint32_t left = 0;
+    // Or: the right child, Concat: number of children, Repeat: the count
+    uint32_t right = 0;
 };
 
-struct OrNode {
-    std::unique_ptr<RegexAST> left;
-    std::unique_ptr<RegexAST> right;
-};
-
-struct StarNode {
-    std::unique_ptr<RegexAST> left;
-};
-
-struct PlusNode {
-    std::unique_ptr<RegexAST> left;
-};
-
-struct QMarkNode {
-    std::unique_ptr<RegexAST> left;
-};
+// All nodes of a regex in one pool, linking to each other by index.
+//
+// A node is pushed only after its children, so the pool is in post-order: children
+// come before their parents and the nodes of a subtree are one contiguous range ending
+// at its root. Bottom-up passes are a plain loop over the pool, and nothing is
+// allocated per node. A multi-digit number like 24 is a concatenation of literals.
+struct RegexAST {
+    std::vector<RegexNode> nodes;
+    // child lists of the Concat nodes
+    std::vector<uint32_t> children;
+    uint32_t root = 0;
+
+    const RegexNode& operator[](uint32_t i) const { return nodes[i]; }
+    size_t size() const { return nodes.size(); }
+
+    std::span<const uint32_t> children_of(const RegexNode& concat) const {
+        return { children.data() + concat.left, concat.right };
+    }
 
-struct RepeatNode {
-    std::unique_ptr<RegexAST> left;
-    int count;
+    uint32_t push(RegexNode node) {
+        nodes.push_back(node);
+        return nodes.size() - 1;
+    }
 };
 
+// The tokens are taken by value, so a vector straight from RegexLexer::lex() is moved
+// in; source is the pattern they were lexed from.
 class RegexASTBuilder {
 public:
-    RegexASTBuilder(const std::vector<RegexToken>& tokens)
-    : tokens_{tokens} {};
+    RegexASTBuilder(std::string_view source, std::vector<RegexToken> tokens)
+    : source_{source}, tokens_{std::move(tokens)} {};
 
-    std::unique_ptr<RegexAST> build();
+    RegexAST build();
 
 private:
     const RegexToken& peek() const {
@@ -75,12 +76,19 @@ private:
         return tokens_[pos_++];
     };
 
-    std::unique_ptr<RegexAST> expression();
-    std::unique_ptr<RegexAST> concater();
-    std::unique_ptr<RegexAST> base_wrapper();
-    std::unique_ptr<RegexAST> base();
-    std::unique_ptr<RegexAST> group();
-    std::unique_ptr<RegexAST> atom();
+    std::string_view lexeme(const RegexToken& token) const {
+        return token.lexeme(source_);
+    }
+
+    uint32_t expression();
+    uint32_t concater();
+    uint32_t base_wrapper();
+    uint32_t base();
+    uint32_t group();
+    uint32_t atom();
+
+    // concatenation of the nodes pending_[mark..], which are popped
+    uint32_t concat(size_t mark);
 
     bool match(RegexTokenType type) {
         if (pos_ >= tokens_.size()) return false;
@@ -91,18 +99,41 @@ private:
         return pos_ >= tokens_.size();
     }
 
+    std::string_view source_;
     const std::vector<RegexToken> tokens_;
     size_t pos_ = 0;
+    RegexAST ast_;
+    // parts of the concatenations being parsed, shared by all nesting levels
+    std::vector<uint32_t> pending_;
 };
 
-inline std::unique_ptr<RegexAST> RegexASTBuilder::atom() {
-    LiteralNode lit;
-    lit.value = advance().lexeme.value();
+inline uint32_t RegexASTBuilder::concat(size_t mark) {
+    const uint32_t count = pending_.size() - mark;
+    if (count == 1) {
+        const uint32_t node = pending_.back();
+        pending_.pop_back();
+        return node;
+    }
+
+    const uint32_t first = ast_.children.size();
+    ast_.children.insert(ast_.children.end(), pending_.begin() + mark, pending_.end());
+    pending_.resize(mark);
 
-    return std::make_unique<RegexAST>(std::move(lit));
+    return ast_.push({ RegexNodeType::Concat, 0, first, count });
 }
 
-inline std::unique_ptr<RegexAST> RegexASTBuilder::group() {
+inline uint32_t RegexASTBuilder::atom() {
+    const std::string_view value = lexeme(advance());
+
+    const size_t mark = pending_.size();
+    for (char c : value) {
+        pending_.push_back(ast_.push({ RegexNodeType::Literal, c }));
+    }
+
+    return concat(mark);
+}
+
+inline uint32_t RegexASTBuilder::group() {
     advance();
 
     auto node = expression();
@@ -115,7 +146,7 @@ inline std::unique_ptr<RegexAST> RegexASTBuilder::group() {
     return node;
 }
 
-inline std::unique_ptr<RegexAST> RegexASTBuilder::base() {
+inline uint32_t RegexASTBuilder::base() {
     if (match(RegexTokenType::Char) || match(RegexTokenType::Number)) {
         return atom();
     }
@@ -127,23 +158,17 @@ inline std::unique_ptr<RegexAST> RegexASTBuilder::base() {
     throw std::runtime_error("Unexpected token in base()");
 }
 
-inline std::unique_ptr<RegexAST> RegexASTBuilder::base_wrapper() {
+inline uint32_t RegexASTBuilder::base_wrapper() {
     auto node = base();
 
     while (!is_at_end()) {
         if (match(RegexTokenType::Star)) {
             advance();
-
-            StarNode star;
-            star.left = std::move(node);
-            node = std::make_unique<RegexAST>(std::move(star));
+            node = ast_.push({ RegexNodeType::Star, 0, node });
         }
         else if (match(RegexTokenType::Plus)) {
             advance();
-
-            PlusNode plus;
-            plus.left = std::move(node);
-            node = std::make_unique<RegexAST>(std::move(plus));
+            node = ast_.push({ RegexNodeType::Plus, 0, node });
         }
         else if (match(RegexTokenType::Caret)) {
             advance();
@@ -152,20 +177,16 @@ inline std::unique_ptr<RegexAST> RegexASTBuilder::base_wrapper() {
                 throw std::runtime_error("Expected number after ^");
             }
 
-            int count = std::stoi(advance().lexeme.value());
-
-            RepeatNode repeat;
-            repeat.left = std::move(node);
-            repeat.count = count;
+            const std::string_view digits = lexeme(advance());
+            uint32_t count = 0;
+            if (std::from_chars(digits.data(), digits.data() + digits.size(), count).ec != std::errc{}) {
+                throw std::runtime_error("Repeat count is too large");
+            }
 
-            node = std::make_unique<RegexAST>(std::move(repeat));
+            node = ast_.push({ RegexNodeType::Repeat, 0, node, count });
         } else if (match(RegexTokenType::QMark)) {
             advance();
-
-            QMarkNode qmark;
-            qmark.left = std::move(node);
-            node = std::make_unique<RegexAST>(std::move(qmark));
-
+            node = ast_.push({ RegexNodeType::QMark, 0, node });
         } else {
             break;
         }
@@ -175,47 +196,51 @@ inline std::unique_ptr<RegexAST> RegexASTBuilder::base_wrapper() {
 
 }
 
-inline std::unique_ptr<RegexAST> RegexASTBuilder::concater() {
-    std::vector<std::unique_ptr<RegexAST>> nodes;
+inline uint32_t RegexASTBuilder::concater() {
+    const size_t mark = pending_.size();
 
     while (
         !is_at_end() &&
         (match(RegexTokenType::Char) || match(RegexTokenType::LParen) || match(RegexTokenType::Number))
     ) {
-        nodes.push_back(base_wrapper());
+        // base_wrapper() may push and pop pending_ too, never below our mark
+        const uint32_t node = base_wrapper();
+        pending_.push_back(node);
     }
 
-    if (nodes.empty()) {
+    if (pending_.size() == mark) {
         throw std::runtime_error("Expected term");
     }
 
-    if (nodes.size() == 1) {
-        return std::move(nodes[0]);
-    }
-
-    ConcatNode concat;
-    concat.children = std::move(nodes);
-    return std::make_unique<RegexAST>(std::move(concat));
+    return concat(mark);
 }
 
-inline std::unique_ptr<RegexAST> RegexASTBuilder::expression() {
+inline uint32_t RegexASTBuilder::expression() {
     auto node = concater();
 
     while (!is_at_end() && match(RegexTokenType::Or)) {
         advance();
         auto right = concater();
 
-        OrNode orNode;
-        orNode.left = std::move(node);
-        orNode.right = std::move(right);
-
-        node = std::make_unique<RegexAST>(std::move(orNode));
+        node = ast_.push({ RegexNodeType::Or, 0, node, right });
     }
 
     return node;
 }
 
-inline std::unique_ptr<RegexAST> RegexASTBuilder::build() {
+inline RegexAST RegexASTBuilder::build() {
     pos_ = 0;
-    return expression();
+    ast_ = RegexAST{};
+    pending_.clear();
+
+    // roughly one node per token
+    ast_.nodes.reserve(tokens_.size());
+
+    ast_.root = expression();
+
+    if (!is_at_end()) {
+        throw std::runtime_error("Unexpected token after expression");
+    }
+
+    return std::move(ast_);
 }
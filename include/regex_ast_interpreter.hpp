@@ -1,83 +1,86 @@
 #pragma once
 
 #include <random>
-#include <variant>
+#include <vector>
 #include "regex_ast.hpp"
 
 class RegexASTInterpreter {
 public:
-    std::string generate(const RegexAST& node);
+    std::string generate(const RegexAST& ast);
 private:
     std::mt19937 gen_{std::random_device{}()};
+    // a node and how many more times to generate it, the next one on top; a repeat is
+    // one entry with a count, not count copies of its child
+    struct Frame {
+        uint32_t node;
+        uint32_t times;
+    };
+    std::vector<Frame> stack_;
 };
 
 inline std::string RegexASTInterpreter::generate(const RegexAST& ast) {
-    return std::visit([this](auto&& node) -> std::string {
-        using T = std::decay_t<decltype(node)>;
+    std::string result;
 
-        if constexpr (std::is_same_v<T, LiteralNode>) {
-            return { node.value };
-        }
-
-        else if constexpr (std::is_same_v<T, OrNode>) {
-            std::uniform_int_distribution<> dist(0, 1);
+    stack_.clear();
+    stack_.push_back({ ast.root, 1 });
 
-            if (dist(gen_) == 1) {
-                return generate(*node.left);
-            } else {
-                return generate(*node.right);
-            }
+    auto push_times = [this](uint32_t node, uint32_t k) {
+        if (k > 0) {
+            stack_.push_back({ node, k });
         }
+    };
 
-        else if constexpr (std::is_same_v<T, ConcatNode>) {
-            std::string result;
-            for (const auto& child : node.children) {
-                result += generate(*child);
-            }
-            return result;
+    while (!stack_.empty()) {
+        Frame& top = stack_.back();
+        const RegexNode& node = ast[top.node];
+        if (--top.times == 0) {
+            stack_.pop_back();
         }
 
-        else if constexpr (std::is_same_v<T, StarNode>) {
-            std::uniform_int_distribution<> dist(0, 5);
-            int k = dist(gen_);
+        switch (node.type) {
+            case RegexNodeType::Literal:
+                result += node.ch;
+                break;
 
-            std::string result;
-            for (int i = 0; i < k; ++i) {
-                result += generate(*node.left);
+            case RegexNodeType::Or: {
+                std::uniform_int_distribution<> dist(0, 1);
+                push_times(dist(gen_) == 1 ? node.left : node.right, 1);
+                break;
             }
 
-            return result;
-        }
-
-        else if constexpr (std::is_same_v<T, PlusNode>) {
-            std::uniform_int_distribution<> dist(1, 5);
-            int k = dist(gen_);
-
-            std::string result;
-            for (int i = 0; i < k; ++i) {
-                result += generate(*node.left);
+            case RegexNodeType::Concat: {
+                auto children = ast.children_of(node);
+                for (auto it = children.rbegin(); it != children.rend(); ++it) {
+                    push_times(*it, 1);
+                }
+                break;
             }
 
-            return result;
-        }
-
-        else if constexpr (std::is_same_v<T, RepeatNode>) {
-            std::string result;
-            for (int i = 0; i < node.count; ++i)
-                result += generate(*node.left);
+            case RegexNodeType::Star: {
+                std::uniform_int_distribution<> dist(0, 5);
+                push_times(node.left, dist(gen_));
+                break;
+            }
 
-            return result;
-        }
+            case RegexNodeType::Plus: {
+                std::uniform_int_distribution<> dist(1, 5);
+                push_times(node.left, dist(gen_));
+                break;
+            }
 
-        else if constexpr (std::is_same_v<T, QMarkNode>) {
-            std::string result;
+            case RegexNodeType::Repeat:
+                push_times(node.left, node.right);
+                break;
 
-            std::uniform_int_distribution<> dist(0, 1);
-            if (dist(gen_) == 1) {
-                result += generate(*node.left);
+            case RegexNodeType::QMark: {
+                std::uniform_int_distribution<> dist(0, 1);
+                if (dist(gen_) == 1) {
+                    push_times(node.left, 1);
+                }
+                break;
             }
-
-            return result;
         }
-    }, ast);
+    }
+
+    return result;
 }
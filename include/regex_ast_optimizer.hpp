@@ -0,0 +1,331 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <vector>
+#include "regex_ast.hpp"
+
+// Rewrites a RegexAST into a smaller one for the same language.
+//
+//   - nested concatenations are flattened into one, so a multi-digit number is no
+//     longer a Concat of its own
+//   - alternatives are flattened, and repeated ones dropped: a|b|a is a|b
+//   - alternatives starting with the same node share it: ab|ac is a(b|c), and ab|a is
+//     a(b)?
+//   - nested closures collapse: x** and (x?)* are x*, (x+)? is x*, (x?)? is x?,
+//     x+ and x? with a nullable x are x* and x, (x^m)^n is x^(mn), x^1 is x
+//
+// Nodes are hash-consed while rewriting, so equal subtrees are equal ids and the two
+// rules on alternatives are id comparisons. That leaves a DAG with unused nodes in the
+// working pool; the result is copied out of it from the root, back to a post-order pool
+// with one contiguous range per subtree, as every consumer of a RegexAST expects.
+//
+// The node types stay the same. Runs of literals and alternations of single characters
+// are left to the consumers, RegexGenerator emitting them as strings and pick tables.
+
+class RegexASTOptimizer {
+public:
+    explicit RegexASTOptimizer(const RegexAST& ast)
+    : ast_{ast} {};
+
+    RegexAST optimize();
+
+private:
+    // the empty string, only ever an operand while rewriting alternatives
+    static constexpr uint32_t EPSILON = UINT32_MAX;
+
+    uint32_t make(RegexNode node, std::span<const uint32_t> children = {});
+
+    uint32_t concat(std::span<const uint32_t> parts);
+    uint32_t alternate(std::span<const uint32_t> alternatives);
+    uint32_t star(uint32_t node);
+    uint32_t plus(uint32_t node);
+    uint32_t qmark(uint32_t node);
+    uint32_t repeat(uint32_t node, uint32_t count);
+
+    bool nullable(uint32_t node) const {
+        return node == EPSILON || nullable_[node];
+    }
+
+    RegexAST emit(uint32_t root) const;
+
+    const RegexAST& ast_;
+
+    RegexAST work_;
+    std::vector<bool> nullable_;
+    // node type, then its fields or its children -> node in work_
+    std::map<std::vector<uint32_t>, uint32_t> ids_;
+};
+
+inline uint32_t RegexASTOptimizer::make(RegexNode node, std::span<const uint32_t> children) {
+    std::vector<uint32_t> key{ static_cast<uint32_t>(node.type) };
+    if (node.type == RegexNodeType::Concat) {
+        key.insert(key.end(), children.begin(), children.end());
+    } else {
+        key.insert(key.end(), { static_cast<uint32_t>(static_cast<unsigned char>(node.ch)), node.left, node.right });
+    }
+
+    auto [it, inserted] = ids_.emplace(std::move(key), work_.size());
+    if (!inserted) {
+        return it->second;
+    }
+
+    bool is_nullable = false;
+    switch (node.type) {
+        case RegexNodeType::Literal:
+            break;
+        case RegexNodeType::Concat:
+            node.left = work_.children.size();
+            node.right = children.size();
+            work_.children.insert(work_.children.end(), children.begin(), children.end());
+
+            is_nullable = true;
+            for (uint32_t child : children) is_nullable = is_nullable && nullable_[child];
+            break;
+        case RegexNodeType::Or:
+            is_nullable = nullable_[node.left] || nullable_[node.right];
+            break;
+        case RegexNodeType::Star:
+        case RegexNodeType::QMark:
+            is_nullable = true;
+            break;
+        case RegexNodeType::Plus:
+            is_nullable = nullable_[node.left];
+            break;
+        case RegexNodeType::Repeat:
+            is_nullable = node.right == 0 || nullable_[node.left];
+            break;
+    }
+
+    nullable_.push_back(is_nullable);
+    return work_.push(node);
+}
+
+inline uint32_t RegexASTOptimizer::concat(std::span<const uint32_t> parts) {
+    std::vector<uint32_t> flat;
+    for (uint32_t part : parts) {
+        if (part == EPSILON) continue;
+
+        if (work_[part].type == RegexNodeType::Concat) {
+            auto children = work_.children_of(work_[part]);
+            flat.insert(flat.end(), children.begin(), children.end());
+        } else {
+            flat.push_back(part);
+        }
+    }
+
+    if (flat.empty()) return EPSILON;
+    if (flat.size() == 1) return flat.front();
+    return make({ RegexNodeType::Concat }, flat);
+}
+
+inline uint32_t RegexASTOptimizer::alternate(std::span<const uint32_t> alternatives) {
+    // every alternative once, in order of appearance, Or chains taken apart
+    std::vector<uint32_t> flat;
+    bool has_epsilon = false;
+
+    std::vector<uint32_t> pending(alternatives.rbegin(), alternatives.rend());
+    while (!pending.empty()) {
+        const uint32_t node = pending.back();
+        pending.pop_back();
+
+        if (node == EPSILON) {
+            has_epsilon = true;
+        } else if (work_[node].type == RegexNodeType::Or) {
+            pending.push_back(work_[node].right);
+            pending.push_back(work_[node].left);
+        } else if (std::ranges::find(flat, node) == flat.end()) {
+            flat.push_back(node);
+        }
+    }
+
+    auto head = [&](uint32_t node) {
+        return work_[node].type == RegexNodeType::Concat ? work_.children_of(work_[node]).front() : node;
+    };
+    auto rest = [&](uint32_t node) {
+        return work_[node].type == RegexNodeType::Concat ? concat(work_.children_of(work_[node]).subspan(1)) : EPSILON;
+    };
+
+    // alternatives with the same head become head(rest | rest | ...)
+    std::vector<uint32_t> factored;
+    std::vector<bool> used(flat.size(), false);
+    for (size_t i = 0; i < flat.size(); ++i) {
+        if (used[i]) continue;
+
+        std::vector<uint32_t> rests;
+        for (size_t j = i; j < flat.size(); ++j) {
+            if (!used[j] && head(flat[j]) == head(flat[i])) {
+                used[j] = true;
+                rests.push_back(rest(flat[j]));
+            }
+        }
+
+        if (rests.size() == 1) {
+            factored.push_back(flat[i]);
+        } else {
+            const uint32_t parts[] = { head(flat[i]), alternate(rests) };
+            factored.push_back(concat(parts));
+        }
+    }
+
+    if (factored.empty()) return EPSILON;
+
+    // left-deep, as RegexASTBuilder makes them
+    uint32_t out = factored.front();
+    for (size_t i = 1; i < factored.size(); ++i) {
+        out = make({ RegexNodeType::Or, 0, out, factored[i] });
+    }
+    return has_epsilon ? qmark(out) : out;
+}
+
+inline uint32_t RegexASTOptimizer::star(uint32_t node) {
+    if (node == EPSILON) return EPSILON;
+
+    switch (work_[node].type) {
+        case RegexNodeType::Star:
+            return node;
+        case RegexNodeType::Plus:
+        case RegexNodeType::QMark:
+            return star(work_[node].left);
+        default:
+            return make({ RegexNodeType::Star, 0, node });
+    }
+}
+
+inline uint32_t RegexASTOptimizer::plus(uint32_t node) {
+    if (node == EPSILON) return EPSILON;
+
+    switch (work_[node].type) {
+        case RegexNodeType::Star:
+        case RegexNodeType::Plus:
+            return node;
+        default:
+            // with ε in x, x+ already matches the empty string
+            return nullable(node) ? star(node) : make({ RegexNodeType::Plus, 0, node });
+    }
+}
+
+inline uint32_t RegexASTOptimizer::qmark(uint32_t node) {
+    if (node == EPSILON) return EPSILON;
+
+    if (work_[node].type == RegexNodeType::Plus) {
+        return star(work_[node].left);
+    }
+    return nullable(node) ? node : make({ RegexNodeType::QMark, 0, node });
+}
+
+inline uint32_t RegexASTOptimizer::repeat(uint32_t node, uint32_t count) {
+    if (count == 1 || node == EPSILON) return node;
+
+    const RegexNode& inner = work_[node];
+    if (count > 0 && inner.type == RegexNodeType::Star) {
+        return node;
+    }
+    if (count > 0 && inner.type == RegexNodeType::Repeat && inner.right > 0 && inner.right <= UINT32_MAX / count) {
+        return make({ RegexNodeType::Repeat, 0, inner.left, inner.right * count });
+    }
+    return make({ RegexNodeType::Repeat, 0, node, count });
+}
+
+inline RegexAST RegexASTOptimizer::emit(uint32_t root) const {
+    RegexAST out;
+    out.nodes.reserve(ast_.size());
+
+    // (node in work_, children visited so far); done holds the new ids of finished
+    // subtrees, the last ones being the children of the node on top
+    std::vector<std::pair<uint32_t, uint32_t>> stack{ { root, 0 } };
+    std::vector<uint32_t> done;
+
+    while (!stack.empty()) {
+        const auto [id, visited] = stack.back();
+        const RegexNode& node = work_[id];
+
+        uint32_t arity = 1;
+        if (node.type == RegexNodeType::Literal) arity = 0;
+        if (node.type == RegexNodeType::Or) arity = 2;
+        if (node.type == RegexNodeType::Concat) arity = node.right;
+
+        if (visited < arity) {
+            uint32_t child = node.left;
+            if (node.type == RegexNodeType::Concat) child = work_.children_of(node)[visited];
+            if (node.type == RegexNodeType::Or && visited == 1) child = node.right;
+
+            ++stack.back().second;
+            stack.push_back({ child, 0 });
+            continue;
+        }
+
+        RegexNode copy = node;
+        const auto children = std::span(done).last(arity);
+        if (node.type == RegexNodeType::Concat) {
+            copy.left = out.children.size();
+            out.children.insert(out.children.end(), children.begin(), children.end());
+        } else if (node.type == RegexNodeType::Or) {
+            copy.left = children[0];
+            copy.right = children[1];
+        } else if (arity == 1) {
+            copy.left = children[0];
+        }
+
+        done.resize(done.size() - arity);
+        done.push_back(out.push(copy));
+        stack.pop_back();
+    }
+
+    out.root = done.back();
+    return out;
+}
+
+inline RegexAST RegexASTOptimizer::optimize() {
+    work_ = RegexAST{};
+    nullable_.clear();
+    ids_.clear();
+
+    std::vector<uint32_t> ids(ast_.size());
+
+    for (uint32_t i = 0; i < ast_.size(); ++i) {
+        const RegexNode& node = ast_[i];
+        uint32_t id = EPSILON;
+
+        switch (node.type) {
+            case RegexNodeType::Literal:
+                id = make(node);
+                break;
+
+            case RegexNodeType::Concat: {
+                std::vector<uint32_t> parts;
+                for (uint32_t child : ast_.children_of(node)) parts.push_back(ids[child]);
+                id = concat(parts);
+                break;
+            }
+
+            case RegexNodeType::Or: {
+                const uint32_t alternatives[] = { ids[node.left], ids[node.right] };
+                id = alternate(alternatives);
+                break;
+            }
+
+            case RegexNodeType::Star:
+                id = star(ids[node.left]);
+                break;
+
+            case RegexNodeType::Plus:
+                id = plus(ids[node.left]);
+                break;
+
+            case RegexNodeType::QMark:
+                id = qmark(ids[node.left]);
+                break;
+
+            case RegexNodeType::Repeat:
+                id = repeat(ids[node.left], node.right);
+                break;
+        }
+
+        ids[i] = id;
+    }
+
+    // ε itself only comes out of factoring, always inside a ?, so the root is a node
+    return emit(ids[ast_.root]);
+}
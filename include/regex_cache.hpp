@@ -0,0 +1,275 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "counting_nfa.hpp"
+#include "glushkov.hpp"
+#include "regex_ast_optimizer.hpp"
+#include "regex_dfa.hpp"
+#include "regex_generator.hpp"
+#include "regex_lexer.hpp"
+
+// Everything built from a pattern, never changed afterwards: the optimized AST, the
+// matchers and the generator. The AST is built right away, the rest on first use
+// (call_once each), since a caller that only generates strings should not pay for a
+// DFA that can be exponential in the pattern. Either way one instance can be shared by
+// any number of threads.
+//
+// matches() picks the matcher: the Glushkov NFA, unless a repeat is too large to
+// expand (see CountingNFA), like (ab)^10000, whose NFA would have 20000 states and a
+// follow table quadratic in them; those go through the CountingNFA instead.
+//
+// on_built, if given, is called after each lazy part is built, outside of any lock, so
+// an owner that charges byte_size() can do it as soon as the size changes.
+struct CompiledRegex {
+    std::string source;
+    // nodes as parsed, before RegexASTOptimizer
+    size_t parsed_size;
+    RegexAST ast;
+    // whether matches() uses the CountingNFA
+    bool counted;
+
+    explicit CompiledRegex(std::string pattern, std::function<void(const CompiledRegex&)> on_built = {});
+
+    const GlushkovNFA& nfa() const { return built(nfa_); }
+    const CountingNFA& counting_nfa() const { return built(counting_nfa_); }
+    const RegexDFA& dfa() const { return built(dfa_); }
+    const RegexGenerator& generator() const { return built(generator_); }
+
+    bool matches(std::string_view input) const {
+        return counted ? counting_nfa().matches(input) : nfa().matches(input);
+    }
+
+    // heap memory held, roughly, counting only the parts built so far
+    size_t byte_size() const {
+        return source.size() + ast.nodes.size() * sizeof(RegexNode) + ast.children.size() * sizeof(uint32_t)
+             + nfa_.bytes.load(std::memory_order_acquire) + counting_nfa_.bytes.load(std::memory_order_acquire)
+             + dfa_.bytes.load(std::memory_order_acquire) + generator_.bytes.load(std::memory_order_acquire);
+    }
+
+private:
+    template <typename T>
+    struct Lazy {
+        std::once_flag once;
+        std::optional<T> value;
+        // 0 until value is there, so byte_size() never waits for a build
+        std::atomic<size_t> bytes = 0;
+    };
+
+    template <typename T>
+    const T& built(Lazy<T>& lazy) const {
+        bool fresh = false;
+        std::call_once(lazy.once, [&] {
+            lazy.value.emplace(ast);
+            lazy.bytes.store(lazy.value->byte_size(), std::memory_order_release);
+            fresh = true;
+        });
+        if (fresh && on_built_) {
+            on_built_(*this);
+        }
+        return *lazy.value;
+    }
+
+    static RegexAST parse(const std::string& pattern, size_t& parsed_size) {
+        RegexLexer lexer(pattern);
+        RegexASTBuilder builder(pattern, lexer.lex());
+        const RegexAST parsed = builder.build();
+
+        parsed_size = parsed.size();
+        return RegexASTOptimizer(parsed).optimize();
+    }
+
+    mutable Lazy<GlushkovNFA> nfa_;
+    mutable Lazy<CountingNFA> counting_nfa_;
+    mutable Lazy<RegexDFA> dfa_;
+    mutable Lazy<RegexGenerator> generator_;
+
+    std::function<void(const CompiledRegex&)> on_built_;
+};
+
+inline CompiledRegex::CompiledRegex(std::string pattern, std::function<void(const CompiledRegex&)> on_built)
+    : source{std::move(pattern)},
+      ast{parse(source, parsed_size)},
+      counted{CountingNFA::needs_counters(ast)},
+      on_built_{std::move(on_built)} {}
+
+// Thread-safe LRU cache from pattern text to its CompiledRegex.
+//
+// The patterns are spread over SHARDS shards by hash, each with its own lock, list in
+// use order and index, so threads asking for different patterns rarely wait for each
+// other. The pattern is hashed once: the high bits choose the shard, and the index is
+// keyed by views of the cached sources together with that hash, so a hit is one
+// lookup without hashing again or allocating, and a splice to the front of the list.
+//
+// A miss compiles outside the lock; when two threads miss on the same pattern at once
+// the first one to insert wins and the other gets its copy. Each shard holds at most
+// its part of max_bytes, by CompiledRegex::byte_size(), evicting the least recently
+// used entries; entries still held by callers stay alive until they let go. A part of
+// an entry built after it was stored is charged as soon as it is built, through the
+// entry's on_built, which holds the shard weakly so it can outlive the cache. An entry
+// larger than a whole shard, at insertion or once a part is built, is not kept at all:
+// one Glushkov table alone can be several times a shard.
+
+class RegexCache {
+public:
+    static constexpr size_t DEFAULT_MAX_BYTES = size_t{64} << 20;
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    explicit RegexCache(size_t max_bytes = DEFAULT_MAX_BYTES);
+
+    // the compiled pattern, compiling it on a miss; throws like RegexASTBuilder on a bad one
+    std::shared_ptr<const CompiledRegex> get(std::string_view pattern);
+
+    Stats stats();
+
+private:
+    static constexpr size_t SHARDS = 16;
+
+    struct Key {
+        std::string_view text;
+        size_t hash;
+
+        bool operator==(const Key& other) const { return text == other.text; }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const { return key.hash; }
+    };
+
+    struct Entry {
+        std::shared_ptr<const CompiledRegex> regex;
+        size_t hash;
+        // byte_size() as last charged to the shard
+        size_t bytes;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        // most recently used first
+        std::list<Entry> entries;
+        // keys are views of the sources of the entries
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+        size_t bytes = 0;
+        size_t max_bytes;
+        uint64_t evictions = 0;
+
+        explicit Shard(size_t max) : max_bytes{max} {}
+
+        // charges what regex holds now, if it is still the cached entry for its source
+        void recharge(const CompiledRegex& regex, size_t hash);
+        void erase(std::list<Entry>::iterator it);
+        void evict();
+    };
+
+    std::array<std::shared_ptr<Shard>, SHARDS> shards_;
+
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+};
+
+inline RegexCache::RegexCache(size_t max_bytes) {
+    for (auto& shard : shards_) {
+        shard = std::make_shared<Shard>(max_bytes / SHARDS);
+    }
+}
+
+inline std::shared_ptr<const CompiledRegex> RegexCache::get(std::string_view pattern) {
+    // the high bits choose the shard, the map buckets use the low ones
+    const size_t hash = std::hash<std::string_view>{}(pattern);
+    const std::shared_ptr<Shard>& owner = shards_[(hash >> 48) % SHARDS];
+    Shard& shard = *owner;
+
+    {
+        std::lock_guard lock(shard.mutex);
+        auto it = shard.index.find({ pattern, hash });
+        if (it != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return it->second->regex;
+        }
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    auto compiled = std::make_shared<const CompiledRegex>(
+        std::string(pattern),
+        [shard = std::weak_ptr<Shard>(owner), hash](const CompiledRegex& regex) {
+            if (auto alive = shard.lock()) alive->recharge(regex, hash);
+        });
+    const size_t bytes = compiled->byte_size();
+
+    std::lock_guard lock(shard.mutex);
+    auto it = shard.index.find({ pattern, hash });
+    if (it != shard.index.end()) {
+        return it->second->regex;
+    }
+    if (bytes > shard.max_bytes) {
+        return compiled;
+    }
+
+    shard.entries.push_front({ compiled, hash, bytes });
+    shard.index.emplace(Key{ compiled->source, hash }, shard.entries.begin());
+    shard.bytes += bytes;
+    shard.evict();
+
+    return compiled;
+}
+
+inline void RegexCache::Shard::recharge(const CompiledRegex& regex, size_t hash) {
+    std::lock_guard lock(mutex);
+    auto it = index.find({ regex.source, hash });
+    if (it == index.end() || it->second->regex.get() != &regex) {
+        return;
+    }
+
+    Entry& entry = *it->second;
+    const size_t now = regex.byte_size();
+    bytes += now - entry.bytes;
+    entry.bytes = now;
+
+    if (now > max_bytes) {
+        erase(it->second);
+        ++evictions;
+    }
+    evict();
+}
+
+inline void RegexCache::Shard::erase(std::list<Entry>::iterator it) {
+    bytes -= it->bytes;
+    index.erase({ it->regex->source, it->hash });
+    entries.erase(it);
+}
+
+inline void RegexCache::Shard::evict() {
+    while (bytes > max_bytes && !entries.empty()) {
+        erase(std::prev(entries.end()));
+        ++evictions;
+    }
+}
+
+inline RegexCache::Stats RegexCache::stats() {
+    Stats stats{ hits_.load(), misses_.load(), 0, 0, 0 };
+
+    for (auto& shard : shards_) {
+        std::lock_guard lock(shard->mutex);
+        stats.evictions += shard->evictions;
+        stats.entries += shard->entries.size();
+        stats.bytes += shard->bytes;
+    }
+    return stats;
+}
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "regex_ast.hpp"
+
+// Regex matcher on Brzozowski derivatives, built lazily while matching.
+//
+// The derivative of r by c is the regex of what is left of r's strings that start
+// with c, so w is in r exactly when the derivative of r by all of w in turn is
+// nullable. Every derivative is itself a regex, a term in a pool here, and since the
+// smart constructors normalize terms (∅ and ε units, right-nested concatenation, and
+// Or with its operands flattened, sorted and deduplicated) and hash-cons them, equal
+// terms get the same id and a regex only has finitely many derivatives. Those ids are
+// the states of a DFA: every derivative computed is stored in the transition table, so
+// the DFA grows as far as the inputs lead it and no further.
+//
+// Building the matcher only turns the RegexAST into its term, so a regex that is used
+// a few times costs about as much as the states those few inputs visit. r^n stays one
+// term with its count, its derivative being r'r^(n-1).
+
+class DerivativeMatcher {
+public:
+    explicit DerivativeMatcher(const RegexAST& ast);
+
+    // grows the memoized DFA, hence not const
+    bool matches(std::string_view input);
+
+    size_t term_count() const { return terms_.size(); }
+
+private:
+    enum class Kind : uint8_t {
+        Empty,
+        Epsilon,
+        Char,
+        Concat,
+        Or,
+        Star,
+        Repeat
+    };
+
+    struct Term {
+        Kind kind;
+        // Char: its class
+        uint8_t cls = 0;
+        // Concat/Or: the operands, Star/Repeat: the body in a
+        uint32_t a = 0;
+        // Repeat: the count
+        uint32_t b = 0;
+        bool nullable = false;
+
+        bool operator==(const Term& other) const {
+            return kind == other.kind && cls == other.cls && a == other.a && b == other.b;
+        }
+    };
+
+    struct TermHash {
+        size_t operator()(const Term& t) const {
+            uint64_t h = static_cast<uint64_t>(t.kind) | static_cast<uint64_t>(t.cls) << 8;
+            h = h * 0x9e3779b97f4a7c15 ^ t.a;
+            h = h * 0x9e3779b97f4a7c15 ^ t.b;
+            return h ^ (h >> 29);
+        }
+    };
+
+    static constexpr uint32_t EMPTY = 0;
+    static constexpr uint32_t EPSILON = 1;
+    static constexpr int32_t UNKNOWN = -1;
+
+    uint32_t intern(Term term);
+
+    uint32_t concat(uint32_t a, uint32_t b);
+    uint32_t alternate(uint32_t a, uint32_t b);
+    uint32_t star(uint32_t a);
+    uint32_t repeat(uint32_t a, uint32_t count);
+
+    uint32_t derive(uint32_t term, uint8_t cls);
+
+    std::vector<Term> terms_;
+    std::unordered_map<Term, uint32_t, TermHash> ids_;
+    // scratch for the operands of an Or
+    std::vector<uint32_t> operands_;
+
+    std::array<uint8_t, 256> class_of_{};
+    size_t width_ = 1;
+
+    // [term][class] -> derivative, UNKNOWN until computed
+    std::vector<int32_t> table_;
+
+    uint32_t root_ = EMPTY;
+};
+
+inline uint32_t DerivativeMatcher::intern(Term term) {
+    auto [it, inserted] = ids_.emplace(term, terms_.size());
+    if (inserted) {
+        terms_.push_back(term);
+        table_.resize(terms_.size() * width_, UNKNOWN);
+    }
+    return it->second;
+}
+
+inline uint32_t DerivativeMatcher::concat(uint32_t a, uint32_t b) {
+    if (a == EMPTY || b == EMPTY) return EMPTY;
+    if (a == EPSILON) return b;
+    if (b == EPSILON) return a;
+
+    // (xy)b is x(yb)
+    const Term left = terms_[a];
+    if (left.kind == Kind::Concat) {
+        return concat(left.a, concat(left.b, b));
+    }
+
+    return intern({ Kind::Concat, 0, a, b, left.nullable && terms_[b].nullable });
+}
+
+inline uint32_t DerivativeMatcher::alternate(uint32_t a, uint32_t b) {
+    if (a == b) return a;
+    if (a == EMPTY) return b;
+    if (b == EMPTY) return a;
+
+    // both sides are already sorted chains, merge them into one
+    const size_t mark = operands_.size();
+    for (uint32_t side : { a, b }) {
+        while (terms_[side].kind == Kind::Or) {
+            operands_.push_back(terms_[side].a);
+            side = terms_[side].b;
+        }
+        operands_.push_back(side);
+    }
+
+    auto begin = operands_.begin() + mark;
+    std::sort(begin, operands_.end());
+    operands_.erase(std::unique(begin, operands_.end()), operands_.end());
+
+    uint32_t out = operands_.back();
+    for (size_t i = operands_.size() - 1; i-- > mark; ) {
+        const uint32_t first = operands_[i];
+        out = intern({ Kind::Or, 0, first, out, terms_[first].nullable || terms_[out].nullable });
+    }
+
+    operands_.resize(mark);
+    return out;
+}
+
+inline uint32_t DerivativeMatcher::star(uint32_t a) {
+    if (a == EMPTY || a == EPSILON) return EPSILON;
+    if (terms_[a].kind == Kind::Star) return a;
+
+    return intern({ Kind::Star, 0, a, 0, true });
+}
+
+inline uint32_t DerivativeMatcher::repeat(uint32_t a, uint32_t count) {
+    if (count == 0 || a == EPSILON) return EPSILON;
+    if (count == 1 || a == EMPTY) return a;
+
+    return intern({ Kind::Repeat, 0, a, count, terms_[a].nullable });
+}
+
+inline uint32_t DerivativeMatcher::derive(uint32_t term, uint8_t cls) {
+    const int32_t known = table_[term * width_ + cls];
+    if (known != UNKNOWN) {
+        return known;
+    }
+
+    // terms_ grows below, so no reference into it
+    const Term t = terms_[term];
+    uint32_t out = EMPTY;
+
+    switch (t.kind) {
+        case Kind::Empty:
+        case Kind::Epsilon:
+            break;
+
+        case Kind::Char:
+            out = t.cls == cls ? EPSILON : EMPTY;
+            break;
+
+        case Kind::Concat:
+            out = concat(derive(t.a, cls), t.b);
+            if (terms_[t.a].nullable) {
+                out = alternate(out, derive(t.b, cls));
+            }
+            break;
+
+        case Kind::Or:
+            out = alternate(derive(t.a, cls), derive(t.b, cls));
+            break;
+
+        case Kind::Star:
+            out = concat(derive(t.a, cls), term);
+            break;
+
+        case Kind::Repeat:
+            // with a nullable r, r^(n-1) already holds what r^(n-2) etc. would add
+            out = concat(derive(t.a, cls), repeat(t.a, t.b - 1));
+            break;
+    }
+
+    table_[term * width_ + cls] = out;
+    return out;
+}
+
+inline DerivativeMatcher::DerivativeMatcher(const RegexAST& ast) {
+    for (const RegexNode& node : ast.nodes) {
+        if (node.type != RegexNodeType::Literal) continue;
+
+        uint8_t& cls = class_of_[static_cast<unsigned char>(node.ch)];
+        if (cls == 0) {
+            cls = width_++;
+        }
+    }
+
+    intern({ Kind::Empty, 0, 0, 0, false });
+    intern({ Kind::Epsilon, 0, 0, 0, true });
+
+    std::vector<uint32_t> terms(ast.size());
+
+    for (uint32_t i = 0; i < ast.size(); ++i) {
+        const RegexNode& node = ast[i];
+        uint32_t term = EMPTY;
+
+        switch (node.type) {
+            case RegexNodeType::Literal:
+                term = intern({ Kind::Char, class_of_[static_cast<unsigned char>(node.ch)] });
+                break;
+
+            case RegexNodeType::Concat: {
+                auto children = ast.children_of(node);
+                term = EPSILON;
+                for (auto it = children.rbegin(); it != children.rend(); ++it) {
+                    term = concat(terms[*it], term);
+                }
+                break;
+            }
+
+            case RegexNodeType::Or:
+                term = alternate(terms[node.left], terms[node.right]);
+                break;
+
+            case RegexNodeType::Star:
+                term = star(terms[node.left]);
+                break;
+
+            case RegexNodeType::Plus:
+                term = concat(terms[node.left], star(terms[node.left]));
+                break;
+
+            case RegexNodeType::Repeat:
+                term = repeat(terms[node.left], node.right);
+                break;
+
+            case RegexNodeType::QMark:
+                term = alternate(terms[node.left], EPSILON);
+                break;
+        }
+
+        terms[i] = term;
+    }
+
+    root_ = terms[ast.root];
+}
+
+inline bool DerivativeMatcher::matches(std::string_view input) {
+    uint32_t state = root_;
+
+    for (char c : input) {
+        const uint8_t cls = class_of_[static_cast<unsigned char>(c)];
+        // class 0, a character outside the regex, only ever derives to ∅
+        if (cls == 0) return false;
+
+        state = derive(state, cls);
+        if (state == EMPTY) return false;
+    }
+    return terms_[state].nullable;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "finite_automaton.hpp"
+#include "regex_positions.hpp"
+
+// DFA built straight from the followpos sets (Aho-Sethi-Ullman), no NFA in between.
+//
+// A DFA state is a set of positions, the positions that can have matched the last
+// character read. The start state holds a single extra pseudo-position whose followpos
+// is firstpos of the regex, so it needs no special casing: on character c every state
+// moves to the union of followpos over its positions, restricted to positions of c.
+// A state accepts when it holds a lastpos position, or is the start state of a
+// nullable regex.
+//
+// Characters are mapped to classes first, one per distinct regex character plus class
+// 0 for everything else, so the transition table is states x classes with a dead
+// column 0 instead of states x 256.
+
+class RegexDFA {
+public:
+    static constexpr int32_t DEAD = -1;
+    static constexpr size_t NO_MATCH = static_cast<size_t>(-1);
+
+    explicit RegexDFA(const RegexAST& ast);
+
+    size_t state_count() const { return accepting_.size(); }
+    size_t class_count() const { return width_; }
+    // heap memory held, roughly
+    size_t byte_size() const {
+        return table_.size() * sizeof(int32_t) + accepting_.size() / 8 + class_char_.size();
+    }
+
+    // successor on a character class, class 0 being the characters outside the regex
+    int32_t next(int32_t state, size_t cls) const { return table_[state * width_ + cls]; }
+    bool is_accepting(int32_t state) const { return accepting_[state]; }
+    char class_char(size_t cls) const { return class_char_[cls]; }
+
+    bool accepts(std::string_view input) const;
+    // length of the longest prefix of input in the language, NO_MATCH if there is none
+    size_t longest_match(std::string_view input) const;
+
+    // the same automaton with string states d0, d1, ..., d0 being the start state
+    FiniteAutomaton to_finite_automaton() const;
+
+private:
+    int32_t step(int32_t state, char c) const {
+        return table_[state * width_ + class_of_[static_cast<unsigned char>(c)]];
+    }
+
+    std::array<uint8_t, 256> class_of_{};
+    std::vector<char> class_char_;
+    size_t width_ = 1;
+
+    std::vector<int32_t> table_;
+    std::vector<bool> accepting_;
+};
+
+inline RegexDFA::RegexDFA(const RegexAST& ast) {
+    const RegexPositions positions(ast);
+    const uint32_t start = positions.size();
+
+    class_char_.push_back('\0');
+    for (char c : positions.symbol) {
+        uint8_t& cls = class_of_[static_cast<unsigned char>(c)];
+        if (cls == 0) {
+            cls = width_++;
+            class_char_.push_back(c);
+        }
+    }
+
+    std::map<std::vector<uint32_t>, int32_t> ids;
+    std::vector<const std::vector<uint32_t>*> sets;
+
+    auto intern = [&](std::vector<uint32_t> set) {
+        auto [it, inserted] = ids.emplace(std::move(set), sets.size());
+        if (inserted) {
+            sets.push_back(&it->first);
+        }
+        return it->second;
+    };
+
+    intern({ start });
+
+    std::vector<std::vector<uint32_t>> buckets(width_);
+
+    // sets grows while we walk it, every new state gets its row in turn
+    for (size_t s = 0; s < sets.size(); ++s) {
+        bool accepting = false;
+
+        for (uint32_t p : *sets[s]) {
+            const auto& follow = p == start ? positions.first : positions.follow[p];
+            for (uint32_t q : follow) {
+                buckets[class_of_[static_cast<unsigned char>(positions.symbol[q])]].push_back(q);
+            }
+
+            accepting = accepting || (p == start ? positions.nullable : static_cast<bool>(positions.last[p]));
+        }
+
+        accepting_.push_back(accepting);
+        table_.resize(table_.size() + width_, DEAD);
+
+        for (size_t cls = 1; cls < width_; ++cls) {
+            auto& bucket = buckets[cls];
+            if (bucket.empty()) continue;
+
+            std::ranges::sort(bucket);
+            auto [a, b] = std::ranges::unique(bucket);
+            bucket.erase(a, b);
+
+            const int32_t next = intern(std::move(bucket));
+            table_[s * width_ + cls] = next;
+            bucket.clear();
+        }
+    }
+}
+
+inline bool RegexDFA::accepts(std::string_view input) const {
+    int32_t state = 0;
+
+    for (char c : input) {
+        state = step(state, c);
+        if (state == DEAD) return false;
+    }
+    return accepting_[state];
+}
+
+inline size_t RegexDFA::longest_match(std::string_view input) const {
+    int32_t state = 0;
+    size_t longest = accepting_[0] ? 0 : NO_MATCH;
+
+    for (size_t i = 0; i < input.size(); ++i) {
+        state = step(state, input[i]);
+        if (state == DEAD) break;
+        if (accepting_[state]) longest = i + 1;
+    }
+    return longest;
+}
+
+inline FiniteAutomaton RegexDFA::to_finite_automaton() const {
+    auto name = [](size_t state) { return "d" + std::to_string(state); };
+
+    States states;
+    Alphabet alphabet(class_char_.begin() + 1, class_char_.end());
+    FinalStates finals;
+    Transitions transitions;
+
+    for (size_t s = 0; s < state_count(); ++s) {
+        states.insert(name(s));
+        if (accepting_[s]) {
+            finals.insert(name(s));
+        }
+
+        for (size_t cls = 1; cls < width_; ++cls) {
+            const int32_t next = table_[s * width_ + cls];
+            if (next != DEAD) {
+                transitions[{ name(s), class_char_[cls] }] = { name(next) };
+            }
+        }
+    }
+
+    return FiniteAutomaton(states, alphabet, name(0), finals, transitions);
+}
@@ -0,0 +1,440 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "regex_ast.hpp"
+
+// splitmix64, small and fast enough that the generator is not waiting on it
+class FastRng {
+public:
+    explicit FastRng(uint64_t seed = 0) : state_{seed} {}
+
+    uint64_t next() {
+        uint64_t z = (state_ += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [0, n), by multiply-shift; the bias is below n / 2^32
+    uint32_t below(uint32_t n) {
+        return static_cast<uint32_t>(((next() >> 32) * n) >> 32);
+    }
+
+private:
+    uint64_t state_;
+};
+
+// Random strings of a regex, compiled to bytecode once and run by a small VM.
+//
+// Same distribution as RegexASTInterpreter: each | picks a side with probability 1/2,
+// * repeats 0..5 times, + 1..5 times, ? 0..1 times, all uniformly. The program is:
+//
+//   EMIT c                  append c
+//   EMITS text              append a run of literal characters from the text pool
+//   PICKC bits, table       append table[random bits], a table of 2^bits characters
+//   PICKS bits, table       the same for a table of strings
+//   REPEATS lo, hi, text    append text k times, k uniform in [lo, hi]
+//   SPLIT jump              with probability 1/2 continue at pc + jump
+//   JUMP jump               continue at pc + jump
+//   LOOP lo, hi, jump       pick k in [lo, hi]; k = 0 skips the body at pc + jump,
+//                           otherwise k goes on the counter stack
+//   NEXT jump               decrement the top counter, back to the body while nonzero
+//
+// Jumps are relative, so the code of a subtree is position independent and the
+// compiler just concatenates the fragments of the children, bottom-up over the pool.
+//
+// Most of the time goes into mispredicted branches on random decisions, so the
+// compiler avoids them where it can. Runs of literals become one EMITS. An alternation
+// of plain strings, nested up to MAX_PICK_BITS deep, is one PICK: a branch d levels
+// deep has probability 2^-d, so it gets 2^(bits - d) slots of the table and a single
+// random number picks the slot. Loops around plain strings are a single REPEATS, and
+// small fixed repeats are unrolled, and r? is compiled as (r|ε). What is left is
+// SPLIT and LOOP/NEXT.
+//
+// Bulk generation writes strings straight into one buffer per thread, each thread with
+// an RNG of its own derived from the seed, and joins the buffers in thread order.
+
+class RegexGenerator {
+public:
+    explicit RegexGenerator(const RegexAST& ast);
+
+    size_t program_size() const { return code_.size(); }
+    // heap memory held, roughly
+    size_t byte_size() const {
+        return code_.size() * sizeof(Instr) + text_.size() + spans_.size() * sizeof(spans_[0]);
+    }
+
+    std::string generate(FastRng& rng) const;
+    // count strings, each followed by separator
+    std::string generate_many(size_t count, FastRng& rng, char separator = '\n') const;
+    // the same split over threads; the output depends on seed and threads only
+    std::string generate_bulk(size_t count, uint64_t seed, unsigned threads, char separator = '\n') const;
+
+private:
+    enum class Op : uint8_t { Emit, EmitString, PickChar, PickString, RepeatString, Split, Jump, Loop, Next };
+
+    struct Instr {
+        Op op;
+        char ch = 0;
+        int32_t jump = 0;
+        // EmitString/RepeatString: offset and length into text_,
+        // PickChar: offset into text_ and bits, PickString: offset into spans_ and bits
+        uint32_t a = 0;
+        uint32_t b = 0;
+        // Loop/RepeatString: bounds of the count
+        uint32_t lo = 0;
+        uint32_t hi = 0;
+    };
+
+    struct Alternative {
+        std::string text;
+        uint32_t depth;
+    };
+
+    // The code of a subtree, then an alternation of strings and then literal text,
+    // both not compiled yet so that they can still be merged with their neighbours.
+    struct Fragment {
+        std::vector<Instr> code;
+        std::vector<Alternative> choice;
+        std::string tail;
+
+        bool is_text() const { return code.empty() && choice.empty(); }
+    };
+
+    static constexpr uint32_t MAX_PICK_BITS = 8;
+    // fixed repeats are unrolled up to this much text or code
+    static constexpr size_t MAX_UNROLL = 64;
+
+    uint32_t add_text(const std::string& text);
+    void materialize(Fragment& f);
+    void append(Fragment& out, Fragment& part);
+    Fragment alternate(Fragment& left, Fragment& right);
+    Fragment loop(Fragment body, uint32_t lo, uint32_t hi);
+
+    void run(std::string& out, FastRng& rng, std::vector<uint32_t>& counters) const;
+
+    std::vector<Instr> code_;
+    std::string text_;
+    // offset and length into text_, the entries of PickString tables
+    std::vector<std::pair<uint32_t, uint32_t>> spans_;
+};
+
+inline uint32_t RegexGenerator::add_text(const std::string& text) {
+    const uint32_t offset = text_.size();
+    text_ += text;
+    return offset;
+}
+
+inline void RegexGenerator::materialize(Fragment& f) {
+    if (!f.choice.empty()) {
+        uint32_t bits = 0;
+        bool chars = true;
+        for (const auto& alt : f.choice) {
+            bits = std::max(bits, alt.depth);
+            chars = chars && alt.text.size() == 1;
+        }
+
+        // alternatives in slot order
+        std::vector<const std::string*> slots;
+        for (const auto& alt : f.choice) {
+            slots.insert(slots.end(), size_t{1} << (bits - alt.depth), &alt.text);
+        }
+
+        if (chars) {
+            const uint32_t offset = text_.size();
+            for (const auto* text : slots) text_ += *text;
+            f.code.push_back({ Op::PickChar, 0, 0, offset, bits });
+        } else {
+            const uint32_t offset = spans_.size();
+            for (const auto* text : slots) {
+                spans_.emplace_back(add_text(*text), text->size());
+            }
+            f.code.push_back({ Op::PickString, 0, 0, offset, bits });
+        }
+
+        f.choice.clear();
+    }
+
+    if (f.tail.size() == 1) {
+        f.code.push_back({ Op::Emit, f.tail[0] });
+    } else if (!f.tail.empty()) {
+        f.code.push_back({ Op::EmitString, 0, 0, add_text(f.tail), static_cast<uint32_t>(f.tail.size()) });
+    }
+    f.tail.clear();
+}
+
+inline void RegexGenerator::append(Fragment& out, Fragment& part) {
+    if (part.is_text()) {
+        out.tail += part.tail;
+        return;
+    }
+
+    materialize(out);
+    out.code.insert(out.code.end(), part.code.begin(), part.code.end());
+    out.choice = std::move(part.choice);
+    out.tail = std::move(part.tail);
+}
+
+inline RegexGenerator::Fragment RegexGenerator::alternate(Fragment& left, Fragment& right) {
+    // the alternatives of a side one level deeper, empty if the side has code
+    auto alternatives = [](const Fragment& f) {
+        std::vector<Alternative> out;
+        if (!f.code.empty()) return out;
+
+        if (f.choice.empty()) {
+            out.push_back({ f.tail, 1 });
+        }
+        for (const auto& alt : f.choice) {
+            // the tail goes into every alternative, (a|b)c is (ac|bc)
+            out.push_back({ alt.text + f.tail, alt.depth + 1 });
+        }
+
+        for (const auto& alt : out) {
+            if (alt.depth > MAX_PICK_BITS) return std::vector<Alternative>{};
+        }
+        return out;
+    };
+
+    Fragment f;
+
+    auto l = alternatives(left);
+    auto r = alternatives(right);
+    if (!l.empty() && !r.empty()) {
+        f.choice = std::move(l);
+        f.choice.insert(f.choice.end(), r.begin(), r.end());
+        return f;
+    }
+
+    materialize(left);
+    materialize(right);
+
+    const int32_t left_size = left.code.size();
+    const int32_t right_size = right.code.size();
+
+    f.code.push_back({ Op::Split, 0, left_size + 2 });
+    f.code.insert(f.code.end(), left.code.begin(), left.code.end());
+    f.code.push_back({ Op::Jump, 0, right_size + 1 });
+    f.code.insert(f.code.end(), right.code.begin(), right.code.end());
+    return f;
+}
+
+inline RegexGenerator::Fragment RegexGenerator::loop(Fragment body, uint32_t lo, uint32_t hi) {
+    if (hi == 0 || (body.is_text() && body.tail.empty())) {
+        return Fragment{};
+    }
+    if (lo == 1 && hi == 1) {
+        return body;
+    }
+    if (lo == 0 && hi == 1) {
+        // r? has the distribution of (r|ε)
+        Fragment empty;
+        return alternate(body, empty);
+    }
+
+    Fragment out;
+
+    if (body.is_text()) {
+        if (lo == hi && body.tail.size() * lo <= MAX_UNROLL) {
+            for (uint32_t k = 0; k < lo; ++k) out.tail += body.tail;
+        } else {
+            const uint32_t size = body.tail.size();
+            out.code.push_back({ Op::RepeatString, 0, 0, add_text(body.tail), size, lo, hi });
+        }
+        return out;
+    }
+
+    materialize(body);
+    const int32_t size = body.code.size();
+
+    if (lo == hi && body.code.size() * lo <= MAX_UNROLL) {
+        for (uint32_t k = 0; k < lo; ++k) {
+            out.code.insert(out.code.end(), body.code.begin(), body.code.end());
+        }
+        return out;
+    }
+
+    out.code.push_back({ Op::Loop, 0, size + 2, 0, 0, lo, hi });
+    out.code.insert(out.code.end(), body.code.begin(), body.code.end());
+    out.code.push_back({ Op::Next, 0, -size });
+    return out;
+}
+
+inline RegexGenerator::RegexGenerator(const RegexAST& ast) {
+    std::vector<Fragment> fragments(ast.size());
+
+    for (uint32_t i = 0; i < ast.size(); ++i) {
+        const RegexNode& node = ast[i];
+        Fragment f;
+
+        switch (node.type) {
+            case RegexNodeType::Literal:
+                f.tail = node.ch;
+                break;
+
+            case RegexNodeType::Concat:
+                for (uint32_t child : ast.children_of(node)) {
+                    append(f, fragments[child]);
+                }
+                break;
+
+            case RegexNodeType::Or:
+                f = alternate(fragments[node.left], fragments[node.right]);
+                break;
+
+            case RegexNodeType::Star:
+                f = loop(std::move(fragments[node.left]), 0, 5);
+                break;
+
+            case RegexNodeType::Plus:
+                f = loop(std::move(fragments[node.left]), 1, 5);
+                break;
+
+            case RegexNodeType::Repeat:
+                f = loop(std::move(fragments[node.left]), node.right, node.right);
+                break;
+
+            case RegexNodeType::QMark:
+                f = loop(std::move(fragments[node.left]), 0, 1);
+                break;
+        }
+
+        fragments[i] = std::move(f);
+    }
+
+    Fragment& root = fragments[ast.root];
+    materialize(root);
+    code_ = std::move(root.code);
+}
+
+inline void RegexGenerator::run(std::string& out, FastRng& rng, std::vector<uint32_t>& counters) const {
+    const Instr* code = code_.data();
+    const size_t size = code_.size();
+
+    auto count = [&rng](const Instr& in) {
+        return in.lo == in.hi ? in.lo : in.lo + rng.below(in.hi - in.lo + 1);
+    };
+
+    for (size_t pc = 0; pc < size; ) {
+        const Instr& in = code[pc];
+
+        switch (in.op) {
+            case Op::Emit:
+                out += in.ch;
+                ++pc;
+                break;
+
+            case Op::EmitString:
+                out.append(text_, in.a, in.b);
+                ++pc;
+                break;
+
+            case Op::PickChar:
+                out += text_[in.a + (rng.next() >> (64 - in.b))];
+                ++pc;
+                break;
+
+            case Op::PickString: {
+                const auto& [offset, length] = spans_[in.a + (rng.next() >> (64 - in.b))];
+                out.append(text_, offset, length);
+                ++pc;
+                break;
+            }
+
+            case Op::RepeatString: {
+                const uint32_t k = count(in);
+                if (in.b == 1) {
+                    out.append(k, text_[in.a]);
+                } else {
+                    for (uint32_t i = 0; i < k; ++i) out.append(text_, in.a, in.b);
+                }
+                ++pc;
+                break;
+            }
+
+            case Op::Split:
+                pc += rng.next() >> 63 ? in.jump : 1;
+                break;
+
+            case Op::Jump:
+                pc += in.jump;
+                break;
+
+            case Op::Loop: {
+                const uint32_t k = count(in);
+                if (k == 0) {
+                    pc += in.jump;
+                } else {
+                    counters.push_back(k);
+                    ++pc;
+                }
+                break;
+            }
+
+            case Op::Next:
+                if (--counters.back() != 0) {
+                    pc += in.jump;
+                } else {
+                    counters.pop_back();
+                    ++pc;
+                }
+                break;
+        }
+    }
+}
+
+inline std::string RegexGenerator::generate(FastRng& rng) const {
+    std::string out;
+    std::vector<uint32_t> counters;
+    run(out, rng, counters);
+    return out;
+}
+
+inline std::string RegexGenerator::generate_many(size_t count, FastRng& rng, char separator) const {
+    std::string out;
+    std::vector<uint32_t> counters;
+
+    for (size_t i = 0; i < count; ++i) {
+        run(out, rng, counters);
+        out += separator;
+    }
+    return out;
+}
+
+inline std::string RegexGenerator::generate_bulk(size_t count, uint64_t seed, unsigned threads, char separator) const {
+    threads = std::max(1u, threads);
+    std::vector<std::string> parts(threads);
+
+    auto work = [&](unsigned t) {
+        // one stream per thread, from the seed and the thread index
+        FastRng seeder(seed);
+        FastRng rng(seeder.next() ^ (t * 0xd1b54a32d192ed03));
+
+        const size_t begin = count * t / threads;
+        const size_t end = count * (t + 1) / threads;
+        parts[t] = generate_many(end - begin, rng, separator);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) {
+        pool.emplace_back(work, t);
+    }
+    work(0);
+
+    for (auto& thread : pool) {
+        thread.join();
+    }
+
+    size_t total = 0;
+    for (const auto& part : parts) total += part.size();
+
+    std::string out = std::move(parts[0]);
+    out.reserve(total);
+    for (unsigned t = 1; t < threads; ++t) {
+        out += parts[t];
+    }
+    return out;
+}
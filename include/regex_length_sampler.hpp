@@ -0,0 +1,490 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "regex_ast.hpp"
+#include "regex_generator.hpp"
+
+// Uniform sampling of the strings of a regex with an exact length, or a bounded one.
+//
+// Every node of the AST gets a table N_v[r], the number of ways v derives a string of
+// length r, for r up to max_length. The pool is in post-order, so one loop fills them
+// bottom-up:
+//
+//   literal   N[1] = 1
+//   r | s     N_r + N_s                   r?   N_r, plus 1 at length 0
+//   r s       N_r * N_s (convolution)     r^k  N_r^k, by splitting k in halves
+//   r*        N[0] = 1, N[n] = sum over k >= 1 of N_r[k] N_*[n - k]
+//   r+        r*, with N[0] = 1 only if r derives ε
+//
+// A star repeats nonempty pieces only, so every count is finite. Walking down from the
+// root and choosing each split or branch with probability proportional to the counts
+// on either side gives every derivation of length n the same probability, with no
+// rejection and no automaton: building the tables is O(nodes * max_length^2) at worst,
+// however many DFA states the pattern would have. When the regex is ambiguous, like
+// (a|b)*a(a|b)*, a string with several derivations is that many times as likely, and
+// log2_count counts derivations as well.
+//
+// The counts grow exponentially, so each is kept as a mantissa in [0.5, 1) and an
+// integer exponent of its own. Tables only reach the longest length a node can
+// derive, so literals and fixed repeats stay small, and sums and choices skip the
+// lengths that have no strings, so a sparse table like (ab)^5000 is cheap.
+//
+// sample_up_to(n) is uniform over all derivations of length at most n: it first draws
+// the length with probability proportional to its count.
+
+class RegexLengthSampler {
+public:
+    RegexLengthSampler(const RegexAST& ast, size_t max_length);
+
+    size_t max_length() const { return max_length_; }
+
+    bool has_length(size_t n) const { return length_count(n).m > 0; }
+    // log2 of the number of strings of length n, -inf if there are none
+    double log2_count(size_t n) const;
+
+    std::optional<std::string> sample(size_t n, FastRng& rng) const;
+    std::optional<std::string> sample_up_to(size_t n, FastRng& rng) const;
+
+private:
+    // m * 2^e, with m in [0.5, 1) or m = 0
+    struct ScaledCount {
+        double m = 0;
+        int64_t e = 0;
+    };
+
+    // the counts of one node, or of a prefix or power of it, by length
+    struct Table {
+        std::vector<double> mantissa;
+        std::vector<int64_t> exponent;
+        // lengths with a nonzero count, ascending
+        std::vector<uint32_t> lengths;
+
+        size_t size() const { return mantissa.size(); }
+    };
+
+    // terms whose exponent is this much below the largest do not show in a double
+    static constexpr int64_t MAX_SHIFT = 1100;
+
+    static ScaledCount normalize(double m, int64_t e) {
+        if (m == 0) return {};
+        int shift = 0;
+        m = std::frexp(m, &shift);
+        return { m, e + shift };
+    }
+
+    static double shifted(int64_t by) {
+        static const auto powers = [] {
+            std::array<double, MAX_SHIFT + 1> p{};
+            for (int64_t i = 0; i <= MAX_SHIFT; ++i) p[i] = std::ldexp(1.0, -static_cast<int>(i));
+            return p;
+        }();
+        return by > MAX_SHIFT ? 0.0 : powers[by];
+    }
+
+    // sum of the terms each(f) passes to f as (mantissa, exponent): one pass finds the
+    // largest exponent, the second adds everything scaled to it
+    template <typename Each>
+    static ScaledCount sum_of(Each&& each);
+
+    // index of one of the terms each(f) passes to f as (index, mantissa, exponent),
+    // with probability proportional to its value; none may be passed for no terms
+    template <typename Each>
+    static size_t pick(Each&& each, FastRng& rng);
+
+    static double uniform(FastRng& rng) {
+        return (rng.next() >> 11) * 0x1.0p-53;
+    }
+
+    ScaledCount length_count(size_t n) const {
+        if (n > max_length_) {
+            throw std::runtime_error("Length " + std::to_string(n) + " is past the sampler's max length");
+        }
+        return count(root_table_, n);
+    }
+
+    ScaledCount count(uint32_t table, size_t r) const {
+        const Table& t = tables_[table];
+        return r < t.size() ? ScaledCount{ t.mantissa[r], t.exponent[r] } : ScaledCount{};
+    }
+
+    // a new table of the given size from the counts make(r) returns
+    template <typename Make>
+    uint32_t add_table(size_t size, Make&& make);
+
+    uint32_t convolve(uint32_t a, uint32_t b, size_t longest);
+    // table of the Repeat node's child repeated k times, memoized per k
+    uint32_t power(uint32_t node, uint32_t k);
+    uint32_t power_table(uint32_t node, uint32_t k) const;
+
+    void sample_node(uint32_t node, size_t n, FastRng& rng, std::string& out) const;
+    void sample_power(uint32_t node, uint32_t k, size_t n, FastRng& rng, std::string& out) const;
+    // length of the second part of a split of n between tables a and b
+    size_t split(uint32_t a, uint32_t b, size_t n, FastRng& rng) const;
+
+    RegexAST ast_;
+    size_t max_length_;
+
+    std::vector<Table> tables_;
+    // table of each node; a Concat of c children has those of its prefixes of 1 .. c - 1
+    // children right before its own
+    std::vector<uint32_t> table_of_;
+    // the table of length 0 only, for r^0 and the empty rest of a star
+    uint32_t empty_table_ = 0;
+    // (node, k) to the table of r^k for k >= 2
+    std::map<std::pair<uint32_t, uint32_t>, uint32_t> powers_;
+    uint32_t root_table_ = 0;
+};
+
+template <typename Each>
+inline RegexLengthSampler::ScaledCount RegexLengthSampler::sum_of(Each&& each) {
+    int64_t top = INT64_MIN;
+    each([&](double, int64_t e) { top = std::max(top, e); });
+    if (top == INT64_MIN) return {};
+
+    double total = 0;
+    each([&](double m, int64_t e) { total += m * shifted(top - e); });
+    return normalize(total, top);
+}
+
+template <typename Each>
+inline size_t RegexLengthSampler::pick(Each&& each, FastRng& rng) {
+    int64_t top = INT64_MIN;
+    each([&](size_t, double, int64_t e) { top = std::max(top, e); });
+
+    double total = 0;
+    each([&](size_t, double m, int64_t e) { total += m * shifted(top - e); });
+
+    // the last term with any weight catches what rounding leaves over
+    double x = uniform(rng) * total;
+    size_t chosen = SIZE_MAX;
+    each([&](size_t i, double m, int64_t e) {
+        const double w = m * shifted(top - e);
+        if (x < 0 || w == 0) return;
+        chosen = i;
+        x -= w;
+    });
+    return chosen;
+}
+
+template <typename Make>
+inline uint32_t RegexLengthSampler::add_table(size_t size, Make&& make) {
+    Table t;
+    t.mantissa.resize(size);
+    t.exponent.resize(size);
+    for (size_t r = 0; r < size; ++r) {
+        const ScaledCount c = make(r);
+        t.mantissa[r] = c.m;
+        t.exponent[r] = c.e;
+        if (c.m > 0) t.lengths.push_back(r);
+    }
+    tables_.push_back(std::move(t));
+    return tables_.size() - 1;
+}
+
+inline uint32_t RegexLengthSampler::convolve(uint32_t a, uint32_t b, size_t longest) {
+    // walk the sparser table, look the other one up
+    if (tables_[a].lengths.size() > tables_[b].lengths.size()) std::swap(a, b);
+    const size_t size = std::min(tables_[a].size() + tables_[b].size() - 1, longest + 1);
+
+    return add_table(size, [&](size_t n) {
+        const Table& ta = tables_[a];
+        const Table& tb = tables_[b];
+        return sum_of([&](auto&& f) {
+            for (uint32_t k : ta.lengths) {
+                if (k > n) break;
+                if (n - k < tb.size() && tb.mantissa[n - k] > 0) {
+                    f(ta.mantissa[k] * tb.mantissa[n - k], ta.exponent[k] + tb.exponent[n - k]);
+                }
+            }
+        });
+    });
+}
+
+inline uint32_t RegexLengthSampler::power(uint32_t node, uint32_t k) {
+    if (k == 0) return empty_table_;
+    if (k == 1) return table_of_[ast_[node].left];
+
+    auto it = powers_.find({ node, k });
+    if (it != powers_.end()) return it->second;
+
+    const uint32_t half = power(node, k / 2);
+    const uint32_t rest = power(node, k - k / 2);
+    const uint32_t t = convolve(half, rest, max_length_);
+    powers_.emplace(std::pair{ node, k }, t);
+    return t;
+}
+
+inline RegexLengthSampler::RegexLengthSampler(const RegexAST& ast, size_t max_length)
+    : ast_{ast},
+      max_length_{max_length},
+      table_of_(ast.size()) {
+    empty_table_ = add_table(1, [](size_t) { return ScaledCount{ 0.5, 1 }; });
+
+    for (uint32_t v = 0; v < ast_.size(); ++v) {
+        const RegexNode& node = ast_[v];
+
+        switch (node.type) {
+            case RegexNodeType::Literal:
+                table_of_[v] = add_table(std::min<size_t>(2, max_length_ + 1), [](size_t r) {
+                    return r == 1 ? ScaledCount{ 0.5, 1 } : ScaledCount{};
+                });
+                break;
+
+            case RegexNodeType::Concat: {
+                const auto children = ast_.children_of(node);
+                uint32_t prefix = add_table(tables_[table_of_[children[0]]].size(), [&](size_t r) {
+                    return count(table_of_[children[0]], r);
+                });
+                for (size_t i = 1; i < children.size(); ++i) {
+                    prefix = convolve(prefix, table_of_[children[i]], max_length_);
+                }
+                table_of_[v] = prefix;
+                break;
+            }
+
+            case RegexNodeType::Or: {
+                const uint32_t l = table_of_[node.left];
+                const uint32_t r = table_of_[node.right];
+                table_of_[v] = add_table(std::max(tables_[l].size(), tables_[r].size()), [&](size_t n) {
+                    const ScaledCount a = count(l, n);
+                    const ScaledCount b = count(r, n);
+                    return sum_of([&](auto&& f) {
+                        if (a.m > 0) f(a.m, a.e);
+                        if (b.m > 0) f(b.m, b.e);
+                    });
+                });
+                break;
+            }
+
+            case RegexNodeType::QMark: {
+                const uint32_t c = table_of_[node.left];
+                table_of_[v] = add_table(tables_[c].size(), [&](size_t n) {
+                    const ScaledCount a = count(c, n);
+                    return sum_of([&](auto&& f) {
+                        if (a.m > 0) f(a.m, a.e);
+                        if (n == 0) f(0.5, 1);
+                    });
+                });
+                break;
+            }
+
+            case RegexNodeType::Star:
+            case RegexNodeType::Plus: {
+                const uint32_t c = table_of_[node.left];
+                const bool grows = !tables_[c].lengths.empty() && tables_[c].lengths.back() > 0;
+                const size_t size = grows ? max_length_ + 1 : 1;
+
+                // N[n] reads N[n - k] for k >= 1, so the table is filled in place; the
+                // pieces after the first are a star, which derives ε once, r+ or not
+                Table t;
+                t.mantissa.assign(size, 0.0);
+                t.exponent.assign(size, 0);
+                t.mantissa[0] = 0.5;
+                t.exponent[0] = 1;
+                for (size_t n = 1; n < size; ++n) {
+                    const Table& tc = tables_[c];
+                    const ScaledCount sum = sum_of([&](auto&& f) {
+                        for (uint32_t k : tc.lengths) {
+                            if (k > n) break;
+                            if (k > 0 && t.mantissa[n - k] > 0) {
+                                f(tc.mantissa[k] * t.mantissa[n - k], tc.exponent[k] + t.exponent[n - k]);
+                            }
+                        }
+                    });
+                    t.mantissa[n] = sum.m;
+                    t.exponent[n] = sum.e;
+                }
+                if (node.type == RegexNodeType::Plus && tables_[c].mantissa[0] == 0) {
+                    t.mantissa[0] = 0;
+                    t.exponent[0] = 0;
+                }
+                for (size_t n = 0; n < size; ++n) {
+                    if (t.mantissa[n] > 0) t.lengths.push_back(n);
+                }
+                tables_.push_back(std::move(t));
+                table_of_[v] = tables_.size() - 1;
+                break;
+            }
+
+            case RegexNodeType::Repeat:
+                table_of_[v] = power(v, node.right);
+                break;
+        }
+    }
+
+    root_table_ = table_of_[ast_.root];
+}
+
+inline uint32_t RegexLengthSampler::power_table(uint32_t node, uint32_t k) const {
+    if (k == 0) return empty_table_;
+    if (k == 1) return table_of_[ast_[node].left];
+    return powers_.at({ node, k });
+}
+
+inline size_t RegexLengthSampler::split(uint32_t a, uint32_t b, size_t n, FastRng& rng) const {
+    const Table& ta = tables_[a];
+    const Table& tb = tables_[b];
+
+    // walk the sparser table for the candidates
+    if (ta.lengths.size() < tb.lengths.size()) {
+        return n - pick([&](auto&& f) {
+            for (uint32_t i : ta.lengths) {
+                if (i > n) break;
+                if (n - i < tb.size() && tb.mantissa[n - i] > 0) {
+                    f(i, ta.mantissa[i] * tb.mantissa[n - i], ta.exponent[i] + tb.exponent[n - i]);
+                }
+            }
+        }, rng);
+    }
+    return pick([&](auto&& f) {
+        for (uint32_t j : tb.lengths) {
+            if (j > n) break;
+            if (n - j < ta.size() && ta.mantissa[n - j] > 0) {
+                f(j, ta.mantissa[n - j] * tb.mantissa[j], ta.exponent[n - j] + tb.exponent[j]);
+            }
+        }
+    }, rng);
+}
+
+inline void RegexLengthSampler::sample_node(uint32_t v, size_t n, FastRng& rng, std::string& out) const {
+    // whatever derives ε writes nothing
+    if (n == 0) return;
+
+    const RegexNode& node = ast_[v];
+    switch (node.type) {
+        case RegexNodeType::Literal:
+            out += node.ch;
+            break;
+
+        case RegexNodeType::Concat: {
+            // the prefix of i children has table table_of_[v] - (c - i); peel the
+            // children off the end, then write them in order
+            const auto children = ast_.children_of(node);
+            const size_t c = children.size();
+            std::vector<size_t> lengths(c);
+            size_t rest = n;
+            for (size_t i = c - 1; i > 0; --i) {
+                lengths[i] = split(table_of_[v] - (c - i), table_of_[children[i]], rest, rng);
+                rest -= lengths[i];
+            }
+            lengths[0] = rest;
+
+            for (size_t i = 0; i < c; ++i) {
+                sample_node(children[i], lengths[i], rng, out);
+            }
+            break;
+        }
+
+        case RegexNodeType::Or: {
+            const ScaledCount l = count(table_of_[node.left], n);
+            const ScaledCount r = count(table_of_[node.right], n);
+            const size_t side = pick([&](auto&& f) {
+                if (l.m > 0) f(0, l.m, l.e);
+                if (r.m > 0) f(1, r.m, r.e);
+            }, rng);
+            sample_node(side == 0 ? node.left : node.right, n, rng, out);
+            break;
+        }
+
+        case RegexNodeType::QMark:
+            sample_node(node.left, n, rng, out);
+            break;
+
+        case RegexNodeType::Star:
+        case RegexNodeType::Plus: {
+            // one nonempty piece at a time, the rest is a star again
+            const Table& tc = tables_[table_of_[node.left]];
+            const Table& t = tables_[table_of_[v]];
+            size_t rest = n;
+            while (rest > 0) {
+                const size_t k = pick([&](auto&& f) {
+                    for (uint32_t j : tc.lengths) {
+                        if (j > rest) break;
+                        if (j == 0) continue;
+                        if (j == rest) {
+                            f(j, tc.mantissa[j], tc.exponent[j]);
+                        } else if (t.mantissa[rest - j] > 0) {
+                            f(j, tc.mantissa[j] * t.mantissa[rest - j], tc.exponent[j] + t.exponent[rest - j]);
+                        }
+                    }
+                }, rng);
+                sample_node(node.left, k, rng, out);
+                rest -= k;
+            }
+            break;
+        }
+
+        case RegexNodeType::Repeat:
+            sample_power(v, node.right, n, rng, out);
+            break;
+    }
+}
+
+inline void RegexLengthSampler::sample_power(uint32_t v, uint32_t k, size_t n, FastRng& rng, std::string& out) const {
+    if (n == 0) return;
+    if (k == 1) {
+        sample_node(ast_[v].left, n, rng, out);
+        return;
+    }
+
+    // the same halves power() built the table from
+    const uint32_t half = k / 2;
+    const size_t second = split(power_table(v, half), power_table(v, k - half), n, rng);
+    sample_power(v, half, n - second, rng, out);
+    sample_power(v, k - half, second, rng, out);
+}
+
+inline double RegexLengthSampler::log2_count(size_t n) const {
+    const ScaledCount c = length_count(n);
+    return c.m > 0 ? c.e + std::log2(c.m) : -INFINITY;
+}
+
+inline std::optional<std::string> RegexLengthSampler::sample(size_t n, FastRng& rng) const {
+    if (!has_length(n)) {
+        return std::nullopt;
+    }
+
+    std::string out;
+    out.reserve(n);
+    sample_node(ast_.root, n, rng, out);
+    return out;
+}
+
+inline std::optional<std::string> RegexLengthSampler::sample_up_to(size_t n, FastRng& rng) const {
+    length_count(n);
+
+    double top = -INFINITY;
+    for (size_t len = 0; len <= n; ++len) {
+        top = std::max(top, log2_count(len));
+    }
+    if (top == -INFINITY) {
+        return std::nullopt;
+    }
+
+    std::vector<double> weights(n + 1);
+    double total = 0;
+    for (size_t len = 0; len <= n; ++len) {
+        weights[len] = std::exp2(log2_count(len) - top);
+        total += weights[len];
+    }
+
+    double x = uniform(rng) * total;
+    size_t chosen = 0;
+    for (size_t len = 0; len <= n; ++len) {
+        if (weights[len] == 0) continue;
+
+        chosen = len;
+        x -= weights[len];
+        if (x < 0) break;
+    }
+
+    return sample(chosen, rng);
+}
@@ -2,80 +2,92 @@
 
 #include "shared.hpp"
 
-#include <string>
+#include <cctype>
+#include <stdexcept>
+#include <string_view>
 
 // (S|T)(U|V)W*Y+24
 // L(U|N)O^3p*Q(2|3)
 // R*S(T|U|V)W(X|Y|Z)^2
 
-
+// The lexer does not copy the pattern and its tokens only point into it, so the
+// pattern has to outlive both.
 class RegexLexer {
 public:
-    RegexLexer(const std::string src) : source_{src} {};
-    std::vector<RegexToken> lex();
+    explicit RegexLexer(std::string_view src) : source_{src} {};
+
+    std::string_view source() const { return source_; }
+
+    std::vector<RegexToken> lex() const;
+    // the same into a buffer of the caller's, which is cleared first and can be reused
+    void lex(std::vector<RegexToken>& out) const;
 
 private:
-    std::vector<RegexToken> out_;
-    const std::string source_;
+    std::string_view source_;
 };
 
-inline std::vector<RegexToken> RegexLexer::lex() {
-    out_.clear();
-    for (size_t i = 0; i < source_.size(); ++i) {
+inline std::vector<RegexToken> RegexLexer::lex() const {
+    std::vector<RegexToken> out;
+    lex(out);
+    return out;
+}
+
+inline void RegexLexer::lex(std::vector<RegexToken>& out) const {
+    if (source_.size() > UINT32_MAX) {
+        throw std::runtime_error("Regex is too long");
+    }
+
+    out.clear();
+    // at most one token per character
+    out.reserve(source_.size());
+
+    for (uint32_t i = 0; i < source_.size(); ++i) {
         char c = source_[i];
 
         switch (c) {
             case '|':
-                out_.push_back({ RegexTokenType::Or, std::nullopt });
+                out.push_back({ RegexTokenType::Or, i, 1 });
                 break;
 
             case '*':
-                out_.push_back({ RegexTokenType::Star, std::nullopt });
+                out.push_back({ RegexTokenType::Star, i, 1 });
                 break;
 
             case '+':
-                out_.push_back({ RegexTokenType::Plus, std::nullopt });
+                out.push_back({ RegexTokenType::Plus, i, 1 });
                 break;
 
             case '^':
-                out_.push_back({ RegexTokenType::Caret, std::nullopt });
+                out.push_back({ RegexTokenType::Caret, i, 1 });
                 break;
 
             case '(':
-                out_.push_back({ RegexTokenType::LParen, std::nullopt });
+                out.push_back({ RegexTokenType::LParen, i, 1 });
                 break;
 
             case ')':
-                out_.push_back({ RegexTokenType::RParen, std::nullopt });
+                out.push_back({ RegexTokenType::RParen, i, 1 });
                 break;
 
             case '?':
-                out_.push_back({ RegexTokenType::QMark, std::nullopt });
+                out.push_back({ RegexTokenType::QMark, i, 1 });
                 break;
 
             default: {
-                if (std::isdigit(c)) {
-                    size_t start = i;
-                    while (i < source_.size() && std::isdigit(source_[i])) {
+                if (std::isdigit(static_cast<unsigned char>(c))) {
+                    uint32_t start = i;
+                    while (i < source_.size() && std::isdigit(static_cast<unsigned char>(source_[i]))) {
                         ++i;
                     }
 
-                    out_.push_back({
-                        RegexTokenType::Number,
-                        source_.substr(start, i - start)
-                    });
+                    out.push_back({ RegexTokenType::Number, start, i - start });
                     --i;
                 }
                 else {
-                    out_.push_back({
-                        RegexTokenType::Char,
-                        std::string(1, c)
-                    });
+                    out.push_back({ RegexTokenType::Char, i, 1 });
                 }
                 break;
             }
         }
     }
-
-    return out_;
 }
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "regex_ast.hpp"
+
+// Literal strings every match of a regex must contain, for prefiltering a search.
+//
+// prefix starts every string of the language, suffix ends every one of them, and factor
+// occurs somewhere inside every one of them; factor is the longest literal found, so it
+// is at least as long as the other two. For (S|T)(U|V)W*Y+24 those are "", "Y24" and
+// "Y24". Any of them may be empty when nothing is required.
+//
+// Computed bottom-up over the node pool. A node that matches exactly one string keeps
+// it, which is how literals grow across a concatenation; otherwise
+//
+//   AB     prefix(A) + ..., ... + suffix(B), and suffix(A) + prefix(B) is a factor
+//   A|B    the common prefix and suffix, and a common substring of the two factors
+//   r*, r? nothing, as the empty string matches
+//
+// Every literal is cut to MAX_LENGTH characters: a part of a required string is still
+// required, and a longer one does not make scanning any faster.
+
+struct RegexLiterals {
+    static constexpr size_t MAX_LENGTH = 64;
+
+    std::string prefix;
+    std::string suffix;
+    std::string factor;
+
+    explicit RegexLiterals(const RegexAST& ast);
+
+private:
+    struct Info {
+        // the single string of the node's language, if it has only one
+        std::optional<std::string> exact;
+        std::string prefix;
+        std::string suffix;
+        std::string factor;
+    };
+
+    static Info concat(Info left, Info right);
+    static Info alternate(Info left, Info right);
+    static Info repeat(Info inner, uint32_t count);
+    static void cut(Info& info);
+
+    static Info exactly(std::string s) {
+        Info info{ s, s, s, s };
+        cut(info);
+        return info;
+    }
+
+    static const std::string& longest(const std::string& a, const std::string& b) {
+        return b.size() > a.size() ? b : a;
+    }
+
+    static std::string common_substring(std::string_view a, std::string_view b);
+};
+
+inline void RegexLiterals::cut(Info& info) {
+    if (info.exact && info.exact->size() > MAX_LENGTH) {
+        info.exact.reset();
+    }
+    if (info.prefix.size() > MAX_LENGTH) {
+        info.prefix.resize(MAX_LENGTH);
+    }
+    if (info.suffix.size() > MAX_LENGTH) {
+        info.suffix.erase(0, info.suffix.size() - MAX_LENGTH);
+    }
+    if (info.factor.size() > MAX_LENGTH) {
+        info.factor.resize(MAX_LENGTH);
+    }
+}
+
+inline std::string RegexLiterals::common_substring(std::string_view a, std::string_view b) {
+    // longest common substring, the strings are at most MAX_LENGTH long
+    std::vector<size_t> run(b.size() + 1, 0);
+    size_t best = 0;
+    size_t best_end = 0;
+
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (size_t j = b.size(); j > 0; --j) {
+            run[j] = a[i] == b[j - 1] ? run[j - 1] + 1 : 0;
+            if (run[j] > best) {
+                best = run[j];
+                best_end = i + 1;
+            }
+        }
+    }
+    return std::string(a.substr(best_end - best, best));
+}
+
+inline RegexLiterals::Info RegexLiterals::concat(Info left, Info right) {
+    if (left.exact && right.exact) {
+        return exactly(*left.exact + *right.exact);
+    }
+
+    Info out;
+    out.prefix = left.exact ? *left.exact + right.prefix : std::move(left.prefix);
+    out.suffix = right.exact ? left.suffix + *right.exact : std::move(right.suffix);
+
+    // every string of AB has suffix(A) right before prefix(B)
+    const std::string across = left.suffix + right.prefix;
+    out.factor = longest(longest(left.factor, right.factor), longest(across, longest(out.prefix, out.suffix)));
+
+    cut(out);
+    return out;
+}
+
+inline RegexLiterals::Info RegexLiterals::alternate(Info left, Info right) {
+    if (left.exact && right.exact && *left.exact == *right.exact) {
+        return left;
+    }
+
+    Info out;
+    const auto [p, q] = std::ranges::mismatch(left.prefix, right.prefix);
+    out.prefix.assign(left.prefix.begin(), p);
+
+    const auto [r, s] = std::mismatch(left.suffix.rbegin(), left.suffix.rend(), right.suffix.rbegin(), right.suffix.rend());
+    out.suffix.assign(r.base(), left.suffix.end());
+
+    out.factor = longest(common_substring(left.factor, right.factor), longest(out.prefix, out.suffix));
+    return out;
+}
+
+inline RegexLiterals::Info RegexLiterals::repeat(Info inner, uint32_t count) {
+    if (count == 0) {
+        return exactly("");
+    }
+
+    if (inner.exact) {
+        // as much of s^count as is kept anyway
+        const std::string& s = *inner.exact;
+        if (s.empty()) {
+            return inner;
+        }
+
+        const size_t kept = std::min<size_t>(size_t{count} * s.size(), MAX_LENGTH + 1);
+        std::string unrolled;
+        while (unrolled.size() < kept) unrolled += s;
+
+        Info out = exactly(unrolled.substr(0, kept));
+        if (size_t{count} * s.size() > MAX_LENGTH) {
+            // the copies end the same way they start, shifted by the length of s
+            out.suffix.clear();
+            while (out.suffix.size() < MAX_LENGTH) out.suffix.insert(0, s);
+            cut(out);
+        }
+        return out;
+    }
+
+    inner.exact.reset();
+    if (count > 1) {
+        // between two iterations
+        inner.factor = longest(inner.factor, inner.suffix + inner.prefix);
+        cut(inner);
+    }
+    return inner;
+}
+
+inline RegexLiterals::RegexLiterals(const RegexAST& ast) {
+    std::vector<Info> infos(ast.size());
+
+    for (uint32_t i = 0; i < ast.size(); ++i) {
+        const RegexNode& node = ast[i];
+        Info info;
+
+        switch (node.type) {
+            case RegexNodeType::Literal:
+                info = exactly(std::string(1, node.ch));
+                break;
+
+            case RegexNodeType::Concat: {
+                auto children = ast.children_of(node);
+                info = std::move(infos[children.front()]);
+                for (uint32_t child : children.subspan(1)) {
+                    info = concat(std::move(info), std::move(infos[child]));
+                }
+                break;
+            }
+
+            case RegexNodeType::Or:
+                info = alternate(std::move(infos[node.left]), std::move(infos[node.right]));
+                break;
+
+            case RegexNodeType::Plus:
+                // r+ starts and ends like r, and contains what r does
+                info = std::move(infos[node.left]);
+                info.exact.reset();
+                break;
+
+            case RegexNodeType::Repeat:
+                info = repeat(std::move(infos[node.left]), node.right);
+                break;
+
+            case RegexNodeType::Star:
+            case RegexNodeType::QMark:
+                break;
+        }
+
+        infos[i] = std::move(info);
+    }
+
+    Info& root = infos[ast.root];
+    prefix = std::move(root.prefix);
+    suffix = std::move(root.suffix);
+    factor = std::move(root.factor);
+}
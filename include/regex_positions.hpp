@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "regex_ast.hpp"
+
+// Position analysis of a RegexAST (Glushkov / Aho-Sethi-Ullman).
+//
+// Every character occurrence of the regex is a position, and r^n is expanded into n
+// copies of r, each with positions of its own. For every node we compute nullable,
+// firstpos and lastpos bottom-up, and followpos gets its edges from concatenation
+// (lastpos of the left part to firstpos of the right part) and from star/plus (lastpos
+// back to firstpos of the same subexpression).
+//
+// The pool is in post-order, so this is one loop over the nodes. Since the nodes of a
+// subtree are contiguous, so are the positions created while visiting them: r^n copies
+// the block of positions of r n - 1 times, shifting the copied edges along with it.
+
+struct RegexPositions {
+    // character of each position
+    std::vector<char> symbol;
+    // followpos of each position, sorted
+    std::vector<std::vector<uint32_t>> follow;
+
+    // firstpos of the whole regex, sorted
+    std::vector<uint32_t> first;
+    // is the position in lastpos of the whole regex
+    std::vector<bool> last;
+    bool nullable = false;
+
+    explicit RegexPositions(const RegexAST& ast);
+
+    size_t size() const { return symbol.size(); }
+
+private:
+    struct Info {
+        bool nullable = true;
+        std::vector<uint32_t> first;
+        std::vector<uint32_t> last;
+        // positions created for this node, [begin, end)
+        uint32_t begin = 0;
+        uint32_t end = 0;
+    };
+
+    Info concat(Info left, Info right);
+    Info loop(Info inner);
+    Info repeat(Info inner, uint32_t count);
+};
+
+inline RegexPositions::RegexPositions(const RegexAST& ast) {
+    std::vector<Info> infos(ast.size());
+
+    for (uint32_t i = 0; i < ast.size(); ++i) {
+        const RegexNode& node = ast[i];
+        const uint32_t begin = symbol.size();
+        Info info;
+
+        // the block of a subtree starts at the block of its leftmost child
+        uint32_t block = begin;
+        if (node.type == RegexNodeType::Concat) {
+            block = infos[ast.children_of(node).front()].begin;
+        } else if (node.type != RegexNodeType::Literal) {
+            block = infos[node.left].begin;
+        }
+
+        switch (node.type) {
+            case RegexNodeType::Literal:
+                symbol.push_back(node.ch);
+                follow.emplace_back();
+                info = Info{ false, { begin }, { begin } };
+                break;
+
+            case RegexNodeType::Concat:
+                for (uint32_t child : ast.children_of(node)) {
+                    info = concat(std::move(info), std::move(infos[child]));
+                }
+                break;
+
+            case RegexNodeType::Or: {
+                info = std::move(infos[node.left]);
+                Info& right = infos[node.right];
+
+                info.nullable = info.nullable || right.nullable;
+                info.first.insert(info.first.end(), right.first.begin(), right.first.end());
+                info.last.insert(info.last.end(), right.last.begin(), right.last.end());
+                break;
+            }
+
+            case RegexNodeType::Star:
+                info = loop(std::move(infos[node.left]));
+                info.nullable = true;
+                break;
+
+            case RegexNodeType::Plus:
+                info = loop(std::move(infos[node.left]));
+                break;
+
+            case RegexNodeType::Repeat:
+                info = repeat(std::move(infos[node.left]), node.right);
+                break;
+
+            case RegexNodeType::QMark:
+                info = std::move(infos[node.left]);
+                info.nullable = true;
+                break;
+        }
+
+        info.begin = block;
+        info.end = symbol.size();
+        infos[i] = std::move(info);
+    }
+
+    Info& info = infos[ast.root];
+
+    for (auto& f : follow) {
+        std::ranges::sort(f);
+        auto [a, b] = std::ranges::unique(f);
+        f.erase(a, b);
+    }
+
+    std::ranges::sort(info.first);
+    first = std::move(info.first);
+
+    last.assign(symbol.size(), false);
+    for (uint32_t p : info.last) last[p] = true;
+
+    nullable = info.nullable;
+}
+
+inline RegexPositions::Info RegexPositions::concat(Info left, Info right) {
+    for (uint32_t p : left.last) {
+        follow[p].insert(follow[p].end(), right.first.begin(), right.first.end());
+    }
+
+    Info out{ left.nullable && right.nullable, std::move(left.first), std::move(right.last) };
+    if (left.nullable) {
+        out.first.insert(out.first.end(), right.first.begin(), right.first.end());
+    }
+    if (right.nullable) {
+        out.last.insert(out.last.end(), left.last.begin(), left.last.end());
+    }
+    return out;
+}
+
+inline RegexPositions::Info RegexPositions::loop(Info inner) {
+    for (uint32_t p : inner.last) {
+        follow[p].insert(follow[p].end(), inner.first.begin(), inner.first.end());
+    }
+    return inner;
+}
+
+inline RegexPositions::Info RegexPositions::repeat(Info inner, uint32_t count) {
+    if (count == 0) {
+        return Info{};
+    }
+
+    // copy the block while it still has only its own edges, chain the copies afterwards
+    std::vector<Info> copies;
+    for (uint32_t k = 1; k < count; ++k) {
+        const uint32_t shift = symbol.size() - inner.begin;
+        Info copy{ inner.nullable, inner.first, inner.last, 0, 0 };
+
+        for (uint32_t p = inner.begin; p < inner.end; ++p) {
+            symbol.push_back(symbol[p]);
+            follow.push_back(follow[p]);
+            for (uint32_t& q : follow.back()) q += shift;
+        }
+        for (uint32_t& p : copy.first) p += shift;
+        for (uint32_t& p : copy.last) p += shift;
+
+        copies.push_back(std::move(copy));
+    }
+
+    for (auto& copy : copies) {
+        inner = concat(std::move(inner), std::move(copy));
+    }
+    return inner;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include "regex_dfa.hpp"
+#include "regex_literals.hpp"
+
+struct RegexMatch {
+    size_t begin;
+    size_t end;
+};
+
+// Unanchored search for a regex in a text, leftmost-longest.
+//
+// Trying the DFA at every position is cheap per try but touches every byte, while in
+// a log most positions cannot start a match at all. Before running the DFA the search
+// skips ahead with the literals of RegexLiterals:
+//
+//   - to the next occurrence of the prefix, if there is one
+//   - or else to the next byte that has a transition out of the start state, and it
+//     stops as soon as the required factor does not occur any more
+//
+// Both scans are memchr for a first byte and memcmp for the rest, which the C library
+// does a vector at a time. On text without matches that is all the search does.
+
+class RegexSearcher {
+public:
+    explicit RegexSearcher(const RegexAST& ast)
+        : RegexSearcher(ast, std::make_shared<const RegexDFA>(ast)) {}
+    // reuses a DFA already built for ast, e.g. CompiledRegex::dfa()
+    RegexSearcher(const RegexAST& ast, std::shared_ptr<const RegexDFA> dfa);
+
+    const RegexLiterals& literals() const { return literals_; }
+
+    // the leftmost match starting at from or later, the longest one there
+    std::optional<RegexMatch> find(std::string_view text, size_t from = 0) const;
+    // number of matches, not overlapping, as find() yields them one after another
+    size_t count(std::string_view text) const;
+
+private:
+    static size_t find_literal(std::string_view text, std::string_view literal, size_t from);
+
+    std::shared_ptr<const RegexDFA> dfa_;
+    RegexLiterals literals_;
+    // bytes with a transition out of the start state
+    std::array<bool, 256> starts_{};
+};
+
+inline RegexSearcher::RegexSearcher(const RegexAST& ast, std::shared_ptr<const RegexDFA> dfa)
+    : dfa_{std::move(dfa)},
+      literals_{ast} {
+    for (size_t cls = 1; cls < dfa_->class_count(); ++cls) {
+        if (dfa_->next(0, cls) != RegexDFA::DEAD) {
+            starts_[static_cast<unsigned char>(dfa_->class_char(cls))] = true;
+        }
+    }
+}
+
+inline size_t RegexSearcher::find_literal(std::string_view text, std::string_view literal, size_t from) {
+    if (from + literal.size() > text.size()) {
+        return std::string_view::npos;
+    }
+
+    const char* at = text.data() + from;
+    // last place the literal can start at, inclusive
+    const char* last = text.data() + text.size() - literal.size();
+
+    while (at <= last) {
+        at = static_cast<const char*>(std::memchr(at, literal[0], last - at + 1));
+        if (at == nullptr) break;
+
+        if (std::memcmp(at + 1, literal.data() + 1, literal.size() - 1) == 0) {
+            return at - text.data();
+        }
+        ++at;
+    }
+    return std::string_view::npos;
+}
+
+inline std::optional<RegexMatch> RegexSearcher::find(std::string_view text, size_t from) const {
+    // the empty string matches right away
+    if (dfa_->is_accepting(0)) {
+        if (from > text.size()) return std::nullopt;
+        return RegexMatch{ from, from + dfa_->longest_match(text.substr(from)) };
+    }
+
+    const std::string_view prefix = literals_.prefix;
+    // with a prefix to find, looking for the factor as well only costs a second scan
+    const std::string_view factor = prefix.empty() ? std::string_view(literals_.factor) : std::string_view();
+    // first occurrence of the factor at or after the position tried
+    size_t next_factor = factor.empty() ? from : find_literal(text, factor, from);
+    if (next_factor == std::string_view::npos) return std::nullopt;
+
+    for (size_t at = from; at < text.size(); ++at) {
+        if (!prefix.empty()) {
+            at = find_literal(text, prefix, at);
+            if (at == std::string_view::npos) return std::nullopt;
+        } else {
+            while (at < text.size() && !starts_[static_cast<unsigned char>(text[at])]) ++at;
+            if (at == text.size()) return std::nullopt;
+        }
+
+        // a match from here on contains an occurrence of the factor from here on
+        if (!factor.empty() && next_factor < at) {
+            next_factor = find_literal(text, factor, at);
+            if (next_factor == std::string_view::npos) return std::nullopt;
+        }
+
+        const size_t length = dfa_->longest_match(text.substr(at));
+        if (length != RegexDFA::NO_MATCH) {
+            return RegexMatch{ at, at + length };
+        }
+    }
+    return std::nullopt;
+}
+
+inline size_t RegexSearcher::count(std::string_view text) const {
+    size_t matches = 0;
+    size_t from = 0;
+
+    while (auto match = find(text, from)) {
+        ++matches;
+        // an empty match still moves on by one
+        from = match->end > match->begin ? match->end : match->begin + 1;
+    }
+    return matches;
+}
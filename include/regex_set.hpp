@@ -0,0 +1,377 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include "regex_positions.hpp"
+
+// Many regexes matched at once, reporting which of them accept the input.
+//
+// The positions of all patterns go into one followpos graph, each position remembering
+// the pattern it came from, with a single start pseudo-position whose followpos is the
+// union of their firstpos sets; the patterns never share a position, so they cannot
+// interfere. Subset construction on that graph gives one DFA for all of them, as in
+// RegexDFA, whose states carry a bitset of the patterns they accept for. The input is
+// read once whatever the number of patterns.
+//
+// The full DFA of hundreds of patterns can be huge, so the states are only built when
+// the input first reaches them and the table is kept as a cache. Once it holds
+// MAX_STATES states it is thrown away and rebuilt from the current state on.
+//
+// longest_prefix() makes it a scanner: the longest prefix any pattern matches, and of
+// the patterns matching that much the one with the lowest id, the way lex resolves
+// rules by their order. A fixed set small enough to build completely, like the rules
+// of a lexer, is better off as a RegexScanner below.
+
+class RegexSet {
+public:
+    struct Prefix {
+        size_t length;
+        size_t pattern;
+    };
+
+    explicit RegexSet(std::span<const RegexAST> patterns);
+
+    // the states point into ids_, which a copy would not bring along
+    RegexSet(const RegexSet&) = delete;
+    RegexSet& operator=(const RegexSet&) = delete;
+    RegexSet(RegexSet&&) = default;
+    RegexSet& operator=(RegexSet&&) = default;
+
+    size_t size() const { return patterns_; }
+    size_t state_count() const { return sets_.size(); }
+
+    // ids of the patterns matching the whole input, in increasing order; builds states
+    // as it goes, hence not const
+    std::vector<size_t> matches(std::string_view input);
+    // nullopt if no pattern matches any prefix, the empty one included
+    std::optional<Prefix> longest_prefix(std::string_view input);
+
+private:
+    static constexpr int32_t DEAD = -1;
+    static constexpr int32_t UNKNOWN = -2;
+    static constexpr size_t MAX_STATES = 10000;
+    static constexpr int32_t NO_PATTERN = -1;
+
+    int32_t intern(std::vector<uint32_t> set);
+    int32_t next(int32_t state, size_t cls);
+    void reset();
+
+    size_t patterns_;
+    size_t words_;
+
+    std::vector<char> symbol_;
+    std::vector<std::vector<uint32_t>> follow_;
+    // per position, the pattern it belongs to if it is in its lastpos, else -1
+    std::vector<int32_t> accepts_for_;
+    // the pseudo-position starting every pattern
+    uint32_t start_;
+    std::vector<uint64_t> nullable_;
+
+    std::array<uint8_t, 256> class_of_{};
+    size_t width_ = 1;
+
+    std::map<std::vector<uint32_t>, int32_t> ids_;
+    std::vector<const std::vector<uint32_t>*> sets_;
+    // [state][class] -> state, UNKNOWN until built
+    std::vector<int32_t> table_;
+    // [state][word] -> patterns accepted
+    std::vector<uint64_t> accepting_;
+    // per state, the lowest pattern accepted or NO_PATTERN
+    std::vector<int32_t> first_accepted_;
+
+    std::vector<std::vector<uint32_t>> buckets_;
+
+    friend class RegexScanner;
+};
+
+// The whole DFA of a RegexSet, built up front into a dense table indexed by state and
+// raw byte, so a step is one load with no character classes or UNKNOWN entries to look
+// at. Nothing changes after the constructor, so a single scanner can be shared by any
+// number of threads. Throws if the DFA has more than RegexSet::MAX_STATES states.
+//
+// The states of a RegexSet are the sets of positions just read, so each byte of a
+// class like [A-Za-z_] gets states of its own. They are merged by Moore's algorithm
+// before the table is laid out: states start out split by the pattern they accept and
+// are split further while they go to different blocks on some class. That keeps the
+// table small enough to stay in the cache.
+class RegexScanner {
+public:
+    explicit RegexScanner(RegexSet set);
+
+    size_t state_count() const { return table_.size() / 256; }
+
+    // the same answer as RegexSet::longest_prefix; open, if given, tells whether the
+    // input ran out before the DFA died, so that more input could make a longer match
+    std::optional<RegexSet::Prefix> longest_prefix(std::string_view input, bool* open = nullptr) const;
+
+private:
+    static constexpr int32_t DEAD = RegexSet::DEAD;
+    static constexpr int32_t NO_PATTERN = RegexSet::NO_PATTERN;
+
+    // [state * 256 + byte] -> the next state times 256, so it indexes the table directly
+    std::vector<int32_t> table_;
+    // [state * 256 + byte] -> the lowest pattern the next state accepts, or NO_PATTERN;
+    // read at the same index as table_, so it does not wait for the next state
+    std::vector<int32_t> accepted_;
+    int32_t start_accepted_;
+};
+
+inline RegexSet::RegexSet(std::span<const RegexAST> patterns)
+    : patterns_{patterns.size()},
+      words_{(patterns.size() + 63) / 64},
+      nullable_(words_, 0) {
+    std::vector<uint32_t> first;
+
+    for (size_t id = 0; id < patterns.size(); ++id) {
+        const RegexPositions positions(patterns[id]);
+        const uint32_t shift = symbol_.size();
+
+        for (uint32_t p = 0; p < positions.size(); ++p) {
+            symbol_.push_back(positions.symbol[p]);
+            follow_.push_back(positions.follow[p]);
+            for (uint32_t& q : follow_.back()) q += shift;
+            accepts_for_.push_back(positions.last[p] ? static_cast<int32_t>(id) : -1);
+        }
+        for (uint32_t p : positions.first) {
+            first.push_back(p + shift);
+        }
+        if (positions.nullable) {
+            nullable_[id / 64] |= uint64_t{1} << (id % 64);
+        }
+    }
+
+    start_ = symbol_.size();
+    symbol_.push_back('\0');
+    follow_.push_back(std::move(first));
+    accepts_for_.push_back(-1);
+
+    for (char c : symbol_) {
+        uint8_t& cls = class_of_[static_cast<unsigned char>(c)];
+        if (cls == 0 && c != '\0') {
+            cls = width_++;
+        }
+    }
+    buckets_.resize(width_);
+
+    reset();
+}
+
+inline void RegexSet::reset() {
+    ids_.clear();
+    sets_.clear();
+    table_.clear();
+    accepting_.clear();
+    first_accepted_.clear();
+
+    intern({ start_ });
+}
+
+inline int32_t RegexSet::intern(std::vector<uint32_t> set) {
+    auto [it, inserted] = ids_.emplace(std::move(set), sets_.size());
+    if (!inserted) {
+        return it->second;
+    }
+
+    sets_.push_back(&it->first);
+    table_.resize(table_.size() + width_, UNKNOWN);
+
+    const size_t row = accepting_.size();
+    accepting_.resize(row + words_, 0);
+    for (uint32_t p : it->first) {
+        if (p == start_) {
+            std::copy(nullable_.begin(), nullable_.end(), accepting_.begin() + row);
+        } else if (accepts_for_[p] >= 0) {
+            accepting_[row + accepts_for_[p] / 64] |= uint64_t{1} << (accepts_for_[p] % 64);
+        }
+    }
+
+    first_accepted_.push_back(NO_PATTERN);
+    for (size_t w = 0; w < words_; ++w) {
+        if (accepting_[row + w] != 0) {
+            first_accepted_.back() = w * 64 + std::countr_zero(accepting_[row + w]);
+            break;
+        }
+    }
+    return it->second;
+}
+
+inline int32_t RegexSet::next(int32_t state, size_t cls) {
+    const int32_t known = table_[state * width_ + cls];
+    if (known != UNKNOWN) {
+        return known;
+    }
+
+    auto& bucket = buckets_[cls];
+    for (uint32_t p : *sets_[state]) {
+        for (uint32_t q : follow_[p]) {
+            if (class_of_[static_cast<unsigned char>(symbol_[q])] == cls) {
+                bucket.push_back(q);
+            }
+        }
+    }
+
+    int32_t out = DEAD;
+    if (!bucket.empty()) {
+        std::ranges::sort(bucket);
+        auto [a, b] = std::ranges::unique(bucket);
+        bucket.erase(a, b);
+
+        out = intern(bucket);
+        bucket.clear();
+    }
+
+    table_[state * width_ + cls] = out;
+    return out;
+}
+
+inline std::vector<size_t> RegexSet::matches(std::string_view input) {
+    int32_t state = 0;
+
+    for (char c : input) {
+        const uint8_t cls = class_of_[static_cast<unsigned char>(c)];
+        if (cls == 0) return {};
+
+        if (sets_.size() >= MAX_STATES) {
+            // start over with only the state we are in
+            std::vector<uint32_t> current = *sets_[state];
+            reset();
+            state = intern(std::move(current));
+        }
+
+        state = next(state, cls);
+        if (state == DEAD) return {};
+    }
+
+    std::vector<size_t> ids;
+    for (size_t w = 0; w < words_; ++w) {
+        for (uint64_t bits = accepting_[state * words_ + w]; bits != 0; bits &= bits - 1) {
+            ids.push_back(w * 64 + std::countr_zero(bits));
+        }
+    }
+    return ids;
+}
+
+inline std::optional<RegexSet::Prefix> RegexSet::longest_prefix(std::string_view input) {
+    int32_t state = 0;
+    std::optional<Prefix> longest;
+    if (first_accepted_[0] != NO_PATTERN) {
+        longest = Prefix{ 0, static_cast<size_t>(first_accepted_[0]) };
+    }
+
+    for (size_t i = 0; i < input.size(); ++i) {
+        const uint8_t cls = class_of_[static_cast<unsigned char>(input[i])];
+        if (cls == 0) break;
+
+        // the cached row first, next() only for a transition not built yet
+        int32_t to = table_[state * width_ + cls];
+        if (to == UNKNOWN) {
+            if (sets_.size() >= MAX_STATES) {
+                std::vector<uint32_t> current = *sets_[state];
+                reset();
+                state = intern(std::move(current));
+            }
+            to = next(state, cls);
+        }
+        if (to == DEAD) break;
+
+        state = to;
+        if (first_accepted_[state] != NO_PATTERN) {
+            longest = Prefix{ i + 1, static_cast<size_t>(first_accepted_[state]) };
+        }
+    }
+    return longest;
+}
+
+inline RegexScanner::RegexScanner(RegexSet set) {
+    // next() appends the states it finds, so this visits every reachable one
+    for (size_t state = 0; state < set.sets_.size(); ++state) {
+        for (size_t cls = 1; cls < set.width_; ++cls) {
+            set.next(static_cast<int32_t>(state), cls);
+        }
+        if (set.sets_.size() > RegexSet::MAX_STATES) {
+            throw std::runtime_error("Too many states for a RegexScanner");
+        }
+    }
+
+    const size_t states = set.sets_.size();
+    const size_t width = set.width_;
+
+    // block of every state, numbered in state order so the start state stays 0
+    std::vector<int32_t> block(states, 0);
+    size_t blocks = 0;
+
+    while (true) {
+        std::map<std::vector<int32_t>, int32_t> ids;
+        std::vector<int32_t> refined(states);
+        std::vector<int32_t> signature(width + 1);
+
+        for (size_t state = 0; state < states; ++state) {
+            signature[0] = block[state];
+            signature[1] = set.first_accepted_[state];
+            for (size_t cls = 1; cls < width; ++cls) {
+                const int32_t to = set.table_[state * width + cls];
+                signature[cls + 1] = to == DEAD ? DEAD : block[to];
+            }
+            refined[state] = ids.emplace(signature, ids.size()).first->second;
+        }
+
+        block = std::move(refined);
+        // blocks only ever split, so the same number means nothing split
+        if (ids.size() == blocks) break;
+        blocks = ids.size();
+    }
+
+    table_.assign(blocks * 256, DEAD);
+    accepted_.assign(blocks * 256, NO_PATTERN);
+    start_accepted_ = set.first_accepted_[0];
+
+    for (size_t state = 0; state < states; ++state) {
+        const size_t row = block[state];
+
+        for (size_t byte = 0; byte < 256; ++byte) {
+            const uint8_t cls = set.class_of_[byte];
+            const int32_t to = cls == 0 ? DEAD : set.table_[state * width + cls];
+            if (to != DEAD) {
+                table_[row * 256 + byte] = block[to] * 256;
+                accepted_[row * 256 + byte] = set.first_accepted_[to];
+            }
+        }
+    }
+}
+
+inline std::optional<RegexSet::Prefix> RegexScanner::longest_prefix(std::string_view input, bool* open) const {
+    const int32_t* table = table_.data();
+    const int32_t* accepted_by = accepted_.data();
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(input.data());
+
+    int32_t state = 0;
+    int32_t pattern = start_accepted_;
+    size_t length = 0;
+
+    for (size_t i = 0; i < input.size(); ++i) {
+        const size_t at = state + bytes[i];
+        state = table[at];
+        if (state == DEAD) break;
+
+        const int32_t accepted = accepted_by[at];
+        if (accepted != NO_PATTERN) {
+            pattern = accepted;
+            length = i + 1;
+        }
+    }
+    if (open) {
+        *open = state != DEAD;
+    }
+
+    if (pattern == NO_PATTERN) {
+        return std::nullopt;
+    }
+    return RegexSet::Prefix{ length, static_cast<size_t>(pattern) };
+}
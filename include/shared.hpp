@@ -1,5 +1,7 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
@@ -35,7 +37,7 @@ using Transitions = std::unordered_map<
     state_char_pair_hash
 >;
 
-enum class RegexTokenType {
+enum class RegexTokenType : uint8_t {
     Or, // |
     Star,
     RParen,
@@ -47,7 +49,14 @@ enum class RegexTokenType {
     QMark
 };
 
+// 12 bytes and nothing on the heap: the text of a token is the range [offset,
+// offset + length) of the pattern it was lexed from
 struct RegexToken {
     RegexTokenType type;
-    std::optional<std::string> lexeme; //not char because of numbers
+    uint32_t offset;
+    uint32_t length; // not 1 because of numbers
+
+    std::string_view lexeme(std::string_view source) const {
+        return source.substr(offset, length);
+    }
 };
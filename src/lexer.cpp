@@ -1,9 +1,192 @@
+#include <algorithm>
+#include <array>
 #include <iostream>
-#include <regex>
 #include <stdexcept>
 
 #include "lexer.hpp"
 
+namespace {
+
+// Turns a rule pattern into a RegexAST, by recursive descent, pushing every node after
+// its children as RegexAST wants it. The RegexAST has no character classes, so a class
+// is an Or of its bytes; byte 0 is left out of them, as a RegexSet cannot read it.
+class RulePatternCompiler {
+public:
+    explicit RulePatternCompiler(std::string_view pattern)
+    : pattern_{pattern} {}
+
+    RegexAST compile() {
+        ast_.root = alternation();
+        if (pos_ < pattern_.size()) {
+            fail("unexpected ')'");
+        }
+        return std::move(ast_);
+    }
+
+private:
+    using ByteSet = std::array<bool, 256>;
+
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error("Bad lexer rule " + std::string(pattern_) + ": " + what);
+    }
+
+    bool at_end() const { return pos_ >= pattern_.size(); }
+    char peek() const { return pattern_[pos_]; }
+
+    char escaped() {
+        if (at_end()) fail("'\\' at the end");
+        const char c = pattern_[pos_++];
+        switch (c) {
+            case 'n': return '\n';
+            case 'r': return '\r';
+            case 't': return '\t';
+            default:  return c;
+        }
+    }
+
+    uint32_t alternation() {
+        uint32_t out = sequence();
+        while (!at_end() && peek() == '|') {
+            ++pos_;
+            const uint32_t right = sequence();
+            out = ast_.push({ RegexNodeType::Or, 0, out, right });
+        }
+        return out;
+    }
+
+    uint32_t sequence() {
+        std::vector<uint32_t> parts;
+        while (!at_end() && peek() != '|' && peek() != ')') {
+            // \b only ever ends a keyword, where the longest match rule already does it
+            if (pattern_.substr(pos_) == "\\b") {
+                pos_ += 2;
+                break;
+            }
+            parts.push_back(postfix());
+        }
+
+        if (parts.empty()) fail("empty alternative");
+        if (parts.size() == 1) return parts.front();
+
+        const uint32_t first = ast_.children.size();
+        ast_.children.insert(ast_.children.end(), parts.begin(), parts.end());
+        return ast_.push({ RegexNodeType::Concat, 0, first, static_cast<uint32_t>(parts.size()) });
+    }
+
+    uint32_t postfix() {
+        uint32_t out = atom();
+        while (!at_end()) {
+            RegexNodeType type;
+            switch (peek()) {
+                case '*': type = RegexNodeType::Star; break;
+                case '+': type = RegexNodeType::Plus; break;
+                case '?': type = RegexNodeType::QMark; break;
+                default:  return out;
+            }
+            ++pos_;
+            out = ast_.push({ type, 0, out });
+        }
+        return out;
+    }
+
+    uint32_t atom() {
+        const char c = pattern_[pos_++];
+        ByteSet set{};
+
+        switch (c) {
+            case '(': {
+                const uint32_t inner = alternation();
+                if (at_end() || peek() != ')') fail("missing ')'");
+                ++pos_;
+                return inner;
+            }
+            case '[':
+                set = byte_class();
+                break;
+            case '.':
+                set.fill(true);
+                set['\n'] = set['\r'] = false;
+                break;
+            case '\\':
+                if (!at_end() && peek() == 'b') fail("\\b anywhere but at the end");
+                set[static_cast<unsigned char>(escaped())] = true;
+                break;
+            case ')':
+            case '*':
+            case '+':
+            case '?':
+                fail(std::string("unexpected '") + c + "'");
+            default:
+                set[static_cast<unsigned char>(c)] = true;
+                break;
+        }
+        return any_of(set);
+    }
+
+    ByteSet byte_class() {
+        ByteSet set{};
+        const bool negated = !at_end() && peek() == '^';
+        if (negated) ++pos_;
+
+        while (!at_end() && peek() != ']') {
+            const char c = pattern_[pos_++];
+            const unsigned char low = c == '\\' ? escaped() : c;
+            unsigned char high = low;
+
+            if (pos_ + 1 < pattern_.size() && peek() == '-' && pattern_[pos_ + 1] != ']') {
+                ++pos_;
+                const char d = pattern_[pos_++];
+                high = d == '\\' ? escaped() : d;
+                if (high < low) fail("bad range");
+            }
+            for (unsigned b = low; b <= high; ++b) set[b] = true;
+        }
+
+        if (at_end()) fail("missing ']'");
+        ++pos_;
+
+        if (negated) {
+            for (bool& in : set) in = !in;
+        }
+        return set;
+    }
+
+    // left-deep Or of the bytes in the set
+    uint32_t any_of(ByteSet set) {
+        set[0] = false;
+
+        uint32_t out = UINT32_MAX;
+        for (unsigned b = 1; b < set.size(); ++b) {
+            if (!set[b]) continue;
+
+            const uint32_t literal = ast_.push({ RegexNodeType::Literal, static_cast<char>(b) });
+            out = out == UINT32_MAX ? literal : ast_.push({ RegexNodeType::Or, 0, out, literal });
+        }
+
+        if (out == UINT32_MAX) fail("empty class");
+        return out;
+    }
+
+    std::string_view pattern_;
+    size_t pos_ = 0;
+    RegexAST ast_;
+};
+
+}
+
+const RegexScanner& Lexer::scanner() {
+    static const RegexScanner compiled = [] {
+        // pattern i of the set is rule i, so ties go to the earlier rule
+        std::vector<RegexAST> patterns;
+        patterns.reserve(std::size(rules_));
+        for (const Rule& rule : rules_) {
+            patterns.push_back(RulePatternCompiler(rule.pattern).compile());
+        }
+        return RegexScanner(RegexSet(patterns));
+    }();
+    return compiled;
+}
+
 const char* Lexer::token_to_str(TokenType t) const {
     switch (t) {
         case TokenType::Identifier:           return "Identifier";
@@ -23,97 +206,149 @@ const char* Lexer::token_to_str(TokenType t) const {
     return "Unknown";
 }
 
-void Lexer::advance_position(const std::string& lexeme) {
-    for (char c : lexeme) {
-        if (c == '\n') {
-            ++line_;
-            col_ = 1;
-            continue;
-        }
-
-        ++col_;
+Lexer::Lexer(std::string src)
+    : owned_{std::move(src)},
+      src_{owned_} {
+    if (src_.size() > UINT32_MAX) {
+        throw std::runtime_error("Source is too large");
     }
 }
 
-Token Lexer::make_token(TokenType type, std::optional<std::string> lexeme, size_t line, size_t column) const {
-    return Token{type, std::move(lexeme), line, column};
+Lexer::Lexer(const MappedFile& file)
+    : src_{file.view()} {
+    if (src_.size() > UINT32_MAX) {
+        throw std::runtime_error("Source is too large");
+    }
 }
 
-void Lexer::debug_log(const std::vector<Token>& tokens) {
-    for (const Token& t : tokens) {
-        std::cout << token_to_str(t.type)
-                  << " @ " << t.line << ':' << t.column;
+Lexer::Lexer(FileStream& stream)
+    : stream_{&stream} {}
 
-        if (t.lexeme) {
-            std::cout << "('" << *t.lexeme << "')";
-        }
-        std::cout << '\n';
+bool Lexer::refill() {
+    if (!stream_) {
+        return false;
     }
-}
+    // the read can move owned_ even when it gets nothing
+    const size_t got = stream_->read(owned_);
+    src_ = owned_;
 
-std::vector<Token> Lexer::lex() {
-    out_.clear();
-    idx_ = 0;
-    line_ = 1;
-    col_ = 1;
+    if (got == 0) {
+        stream_ = nullptr;
+        return false;
+    }
+    if (owned_.size() > UINT32_MAX) {
+        throw std::runtime_error("Source is too large");
+    }
+    return true;
+}
 
-    while (idx_ < src_.size()) {
-        const char* begin = src_.c_str() + idx_;
-        bool matched = false;
+SourcePosition Lexer::position_of(size_t offset) const {
+    Cursor& c = cursor_;
 
-        for (const Rule& rule : rules_) {
-            std::cmatch match;
-            if (!std::regex_search(begin, match, rule.pattern, std::regex_constants::match_continuous)) {
-                continue;
+    if (offset >= c.offset) {
+        for (size_t i = c.offset; i < offset; ++i) {
+            if (src_[i] == '\n') {
+                ++c.line;
+                c.line_start = i + 1;
             }
+        }
+    } else {
+        for (size_t i = offset; i < c.offset; ++i) {
+            if (src_[i] == '\n') --c.line;
+        }
+        // npos + 1 is 0, the first line
+        c.line_start = offset == 0 ? 0 : src_.rfind('\n', offset - 1) + 1;
+    }
 
-            matched = true;
-            const size_t token_line = line_;
-            const size_t token_column = col_;
-            std::string lexeme = match.str();
+    c.offset = offset;
+    return { c.line, offset - c.line_start + 1 };
+}
 
-            idx_ += lexeme.size();
-            advance_position(lexeme);
+void Lexer::debug_log(const Token& t) const {
+    const SourcePosition pos = position(t);
+    std::cout << token_to_str(t.type)
+              << " @ " << pos.line << ':' << pos.column;
 
-            if (rule.skip) {
-                break;
-            }
+    switch (t.type) {
+        case TokenType::Identifier:
+        case TokenType::StringLiteral:
+        case TokenType::Integer:
+        case TokenType::Float:
+        case TokenType::Return:
+        case TokenType::Type:
+            std::cout << "('" << lexeme(t) << "')";
+            break;
+        default:
+            break;
+    }
+    std::cout << '\n';
+}
 
-            if (rule.type == TokenType::StringLiteral) {
-                out_.push_back(make_token(
-                    rule.type,
-                    lexeme.substr(1, lexeme.size() - 2),
-                    token_line,
-                    token_column
-                ));
-                break;
-            }
+void Lexer::debug_log(const std::vector<Token>& tokens) const {
+    for (const Token& t : tokens) {
+        debug_log(t);
+    }
+}
 
-            switch (rule.type) {
-                case TokenType::Identifier:
-                case TokenType::Integer:
-                case TokenType::Float:
-                case TokenType::Return:
-                case TokenType::Type:
-                    out_.push_back(make_token(rule.type, lexeme, token_line, token_column));
-                    break;
-                default:
-                    out_.push_back(make_token(rule.type, std::nullopt, token_line, token_column));
-                    break;
-            }
+Token Lexer::next_token() {
+    while (idx_ < src_.size() || refill()) {
+        bool open = false;
+        const auto match = scanner_.longest_prefix(src_.substr(idx_), &open);
 
-            break;
+        // the scan ran into the end of what is read so far, the token may go on
+        if (open && refill()) {
+            continue;
         }
 
-        if (!matched) {
+        // no rule matches the empty string, so a match is never empty
+        if (!match) {
+            const SourcePosition pos = position_of(idx_);
             throw std::runtime_error(
                 "Unexpected character '" + std::string(1, src_[idx_]) + "' at line " +
-                std::to_string(line_) + ", column " + std::to_string(col_)
+                std::to_string(pos.line) + ", column " + std::to_string(pos.column)
             );
         }
+
+        const Rule& rule = rules_[match->pattern];
+        const uint32_t offset = idx_;
+        const uint32_t length = match->length;
+        idx_ += length;
+
+        if (rule.skip) {
+            continue;
+        }
+
+        if (rule.type == TokenType::StringLiteral) {
+            return { rule.type, offset + 1, length - 2 };
+        }
+
+        return { rule.type, offset, length };
     }
 
-    out_.push_back(make_token(TokenType::NewLine, std::nullopt, line_, col_));
-    out_.push_back(make_token(TokenType::End, std::nullopt, line_, col_));
-    return out_;
+    const uint32_t end = src_.size();
+    if (!at_end_) {
+        at_end_ = true;
+        return { TokenType::NewLine, end, 0 };
+    }
+    return { TokenType::End, end, 0 };
+}
+
+void Lexer::rewind() {
+    idx_ = 0;
+    at_end_ = false;
+}
+
+std::vector<Token> Lexer::lex() {
+    std::vector<Token> out;
+    lex(out);
+    return out;
+}
+
+void Lexer::lex(std::vector<Token>& out) {
+    out.clear();
+    rewind();
+
+    do {
+        out.push_back(next_token());
+    } while (out.back().type != TokenType::End);
 }
@@ -1,4 +1,7 @@
+#include <cstdlib>
+#include <filesystem>
 #include <iostream>
+#include <optional>
 #include <unordered_set>
 #include <fstream>
 #include <sstream>
@@ -7,12 +10,32 @@
 #include "grammar_classifier.hpp"
 #include "finite_automaton.hpp"
 #include "grammar.hpp"
+#include "file_stream.hpp"
 #include "lexer.hpp"
+#include "mapped_file.hpp"
 #include "parser.hpp"
 #include "regex_ast.hpp"
-#include "regex_ast_interpreter.hpp"
+#include "regex_ast_optimizer.hpp"
 #include "regex_lexer.hpp"
 #include "chomsky_normal_form.hpp"
+#include "cyk.hpp"
+#include "earley.hpp"
+#include "incremental_cnf.hpp"
+#include "language_counter.hpp"
+#include "cnf_fuzzer.hpp"
+#include "pcfg_cyk.hpp"
+#include "ll1_parser.hpp"
+#include "lalr_parser.hpp"
+#include "glushkov.hpp"
+#include "grammar_cache.hpp"
+#include "counting_nfa.hpp"
+#include "regex_dfa.hpp"
+#include "regex_derivatives.hpp"
+#include "regex_generator.hpp"
+#include "regex_length_sampler.hpp"
+#include "regex_search.hpp"
+#include "regex_set.hpp"
+#include "regex_cache.hpp"
 
 constexpr int n = 5;
 void solve_lab1() {
@@ -111,22 +134,57 @@ void solve_lab2() {
     std::cout << "\n\n";
 }
 
-void solve_lab3(const std::string& path) {
-    std::ifstream file(path);
-    if (!file) {
-        std::cerr << "Could not open file: " << path << "\n";
-        return;
+// a lexer over the DSL file, together with what it reads from: the file mapped if it
+// is a regular one, otherwise (a pipe, a FIFO, /dev/stdin) read in chunks as the lexer
+// gets to them
+struct Source {
+    std::unique_ptr<MappedFile> file;
+    std::unique_ptr<FileStream> stream;
+    std::unique_ptr<Lexer> lexer;
+};
+
+// nullopt with the error printed
+std::optional<Source> open_source(const std::string& path) {
+    try {
+        Source source;
+        if (std::filesystem::is_regular_file(path)) {
+            source.file = std::make_unique<MappedFile>(path);
+            source.lexer = std::make_unique<Lexer>(*source.file);
+        } else {
+            source.stream = std::make_unique<FileStream>(path);
+            source.lexer = std::make_unique<Lexer>(*source.stream);
+        }
+        return source;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << "\n";
+        return std::nullopt;
     }
+}
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
+// every token, printed as soon as it is lexed
+void log_tokens(Lexer& lexer) {
+    Token token{};
+    do {
+        token = lexer.next_token();
+        lexer.debug_log(token);
+    } while (token.type != TokenType::End);
+}
 
-    Lexer lexer(buffer.str());
+void solve_lab3(const std::string& path) {
+    const auto source = open_source(path);
+    if (!source) {
+        return;
+    }
 
-    auto tokens = lexer.lex();
-    lexer.debug_log(tokens);
+    log_tokens(*source->lexer);
 };
 
+// compiled patterns shared by everything below
+RegexCache& regex_cache() {
+    static RegexCache cache;
+    return cache;
+}
+
 void solve_lab4() {
     std::vector<std::string> regexes = {
         "(S|T)(U|V)W*Y+24",
@@ -134,18 +192,74 @@ void solve_lab4() {
         "R*S(T|U|V)W(X|Y|Z)^2N?"
     };
 
-    for (const auto& regex : regexes) {
-        RegexLexer lexer(regex);
-        auto tokens = lexer.lex();
+    std::vector<std::string> results;
 
-        RegexASTBuilder builder(tokens);
-        auto ast = builder.build();
+    for (const auto& regex : regexes) {
+        const auto compiled = regex_cache().get(regex);
+        const RegexAST& ast = compiled->ast;
+        const GlushkovNFA& nfa = compiled->nfa();
+        const RegexDFA& dfa = compiled->dfa();
+
+        FastRng rng(std::random_device{}());
+        std::string result = compiled->generator().generate(rng);
+        results.push_back(result);
+
+        FiniteAutomaton fa = nfa.to_finite_automaton();
+        DerivativeMatcher derivatives(ast);
+
+        std::cout << result
+                  << " (matches: " << (nfa.matches(result) ? "yes" : "no")
+                  << ", validate_string: " << (fa.validate_string(result) ? "yes" : "no")
+                  << ", dfa: " << (dfa.accepts(result) ? "yes" : "no")
+                  << ", derivatives: " << (derivatives.matches(result) ? "yes" : "no")
+                  << ", " << nfa.state_count() << " NFA / " << dfa.state_count() << " DFA states)\n";
+
+        const RegexLiterals literals(ast);
+        std::cout << "  nodes: " << compiled->parsed_size << " -> " << ast.size() << '\n';
+        std::cout << "  literals: prefix \"" << literals.prefix << "\", suffix \"" << literals.suffix
+                  << "\", factor \"" << literals.factor << "\"\n";
+
+        const size_t length = 16;
+        RegexLengthSampler sampler(ast, length);
+        if (auto exact = sampler.sample(length, rng)) {
+            std::cout << "  length " << length << ": " << *exact
+                      << " (one of 2^" << sampler.log2_count(length) << ")\n";
+        }
+    }
 
-        RegexASTInterpreter interpreter;
-        std::string result = interpreter.generate(*ast);
+    // all three in one automaton, each string read once; the patterns are cached by now
+    std::vector<RegexAST> asts;
+    for (const auto& regex : regexes) {
+        asts.push_back(regex_cache().get(regex)->ast);
+    }
 
-        std::cout << result << '\n';
+    RegexSet set(asts);
+    for (const auto& result : results) {
+        std::cout << result << " matches patterns:";
+        for (size_t id : set.matches(result)) {
+            std::cout << ' ' << id;
+        }
+        std::cout << '\n';
     }
+
+    const auto stats = regex_cache().stats();
+    std::cout << "regex cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.entries << " entries, " << stats.bytes << " bytes\n";
+
+    // too large to expand: one copy of AB and a counter up to 10000, which the cache
+    // matches with the CountingNFA
+    const std::string counted = "(AB)^10000C";
+    const auto compiled = regex_cache().get(counted);
+    const CountingNFA& counting = compiled->counting_nfa();
+
+    FastRng rng(std::random_device{}());
+    std::string input = compiled->generator().generate(rng);
+
+    std::cout << counted << ": " << input.size() << " characters (matches: "
+              << (compiled->matches(input) ? "yes" : "no")
+              << ", one more AB: " << (compiled->matches("AB" + input) ? "yes" : "no")
+              << ", " << counting.position_count() << " positions, "
+              << counting.counter_count() << " counter)\n";
 }
 
 void solve_lab5() {
@@ -176,9 +290,16 @@ void solve_lab5() {
         }}
     };
 
-    ChomskyNormalForm chomsky_normal_form(test_grammar);
-    chomsky_normal_form.normalize();
-    Grammar normalized_grammar = chomsky_normal_form.result();
+    // FORMAL_LANGUAGES_CNF_CACHE=<dir> keeps normalized grammars there for later runs,
+    // by default nothing is written to disk
+    Grammar normalized_grammar;
+    if (const char* cache_dir = std::getenv("FORMAL_LANGUAGES_CNF_CACHE")) {
+        normalized_grammar = GrammarCache(cache_dir).normalize(test_grammar);
+    } else {
+        ChomskyNormalForm chomsky_normal_form(test_grammar);
+        chomsky_normal_form.normalize();
+        normalized_grammar = chomsky_normal_form.result();
+    }
     normalized_grammar.print_grammar();
 
     auto r = check_cnf(normalized_grammar);
@@ -190,6 +311,58 @@ void solve_lab5() {
         std::cout << "=================" << '\n';
     }
 
+    std::cout << "\nMembership (CYK on CNF / Earley on the original grammar):" << '\n';
+    std::cout << "------------------------" << '\n';
+    CYKParser cyk(normalized_grammar);
+    EarleyParser earley(test_grammar);
+    for (const std::string word : { "a", "aa", "ab", "ba", "baaab", "abaab" }) {
+        std::cout << word << ' '
+                  << (cyk.recognize(word) ? "YES" : "NO") << ' '
+                  << (earley.recognize(word) ? "YES" : "NO") << '\n';
+    }
+
+    std::cout << "\nParse forest of \"ba\":" << '\n';
+    std::cout << "------------------------" << '\n';
+    earley.parse("ba")->print();
+
+    std::cout << "\nIncremental CNF after removing C -> ε:" << '\n';
+    std::cout << "------------------------" << '\n';
+    IncrementalCNF incremental(test_grammar);
+    incremental.remove_production("C", {});
+    incremental.result().print_grammar();
+
+    std::cout << "\nParse trees / distinct words by length:" << '\n';
+    std::cout << "------------------------" << '\n';
+    LanguageCounter counter(normalized_grammar, 8);
+    for (size_t n = 1; n <= 8; ++n) {
+        std::cout << n << ": " << counter.tree_count(n) << " / " << counter.word_count(n) << '\n';
+    }
+
+    std::cout << "\nPCFG with uniform rule weights (log inside / log Viterbi):" << '\n';
+    std::cout << "------------------------" << '\n';
+    Grammar weighted_grammar = test_grammar;
+    for (const auto& [lhs, rhses] : weighted_grammar.productions) {
+        weighted_grammar.weights[lhs].assign(rhses.size(), 1.0 / rhses.size());
+    }
+
+    ChomskyNormalForm weighted_normal_form(weighted_grammar);
+    weighted_normal_form.normalize();
+    PCFGParser pcfg(weighted_normal_form.result());
+    for (const std::string word : { "a", "ba", "baaab", "abaab" }) {
+        std::cout << word << ' ' << pcfg.inside(word) << ' ' << pcfg.viterbi(word) << '\n';
+    }
+
+    std::cout << "\nLL(1) conflicts of the original grammar:" << '\n';
+    std::cout << "------------------------" << '\n';
+    LL1Parser ll1(test_grammar);
+    ll1.print_conflicts();
+
+    std::cout << "\nLALR(1) automaton of the original grammar:" << '\n';
+    std::cout << "------------------------" << '\n';
+    LALRParser lalr(test_grammar);
+    std::cout << lalr.state_count() << " states, " << lalr.table_slots() << " packed table slots" << '\n';
+    lalr.print_conflicts();
+
     //Grammar grammar;
     //grammar.start_symbol = "S";
     //grammar.non_terminals = {"S", "A", "B", "C", "D"};
@@ -245,23 +418,20 @@ void solve_lab5() {
 }
 
 void solve_lab6(const std::string& path) {
-    std::ifstream file(path);
-    if (!file) {
-        std::cerr << "Could not open file: " << path << "\n";
+    const auto source = open_source(path);
+    if (!source) {
         return;
     }
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-
-    Lexer lexer(buffer.str());
-    auto tokens = lexer.lex();
+    Lexer& lexer = *source->lexer;
 
     std::cout << "Tokens:\n";
     std::cout << "------------------------\n";
-    lexer.debug_log(tokens);
+    log_tokens(lexer);
 
-    Parser parser(tokens);
+    // a second pass for the parser, which pulls the tokens itself
+    lexer.rewind();
+    Parser parser(lexer);
     auto ast = parser.parse();
 
     std::cout << "\nAST:\n";
@@ -269,12 +439,93 @@ void solve_lab6(const std::string& path) {
     ast->print(std::cout, 0);
 }
 
+void fuzz_cnf(size_t grammars) {
+    FuzzOptions options;
+    options.grammars = grammars;
+
+    CNFFuzzer fuzzer(options);
+    auto report = fuzzer.run();
+
+    std::cout << report.grammars << " grammars, " << report.words << " words in " << report.seconds << "s ("
+              << report.grammars_per_second() << " grammars/s)\n";
+
+    for (const auto& failure : report.failures) {
+        const char* component = failure.component == FuzzComponent::CNF    ? "CNF"
+                              : failure.component == FuzzComponent::LALR   ? "LALR(1)"
+                                                                           : "derivation search";
+        std::cout << "\nFAILED in " << component << " (seed " << failure.seed << "): " << failure.reason << '\n';
+        std::cout << "------------------------" << '\n';
+        failure.grammar.print_grammar();
+        if (failure.component == FuzzComponent::CNF) {
+            std::cout << "\nNormalized:" << '\n';
+            failure.normalized.print_grammar();
+        }
+    }
+}
+
+void generate_strings(const std::string& regex, size_t count) {
+    const auto compiled = regex_cache().get(regex);
+
+    const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    const std::string out = compiled->generator().generate_bulk(count, std::random_device{}(), threads);
+    std::cout.write(out.data(), out.size());
+}
+
+void search_file(const std::string& regex, const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string text = buffer.str();
+
+    // the searcher shares the cached DFA and keeps the entry alive through it
+    const auto compiled = regex_cache().get(regex);
+    RegexSearcher searcher(compiled->ast, std::shared_ptr<const RegexDFA>(compiled, &compiled->dfa()));
+
+    // every line with a match, once
+    size_t from = 0;
+    while (auto match = searcher.find(text, from)) {
+        const size_t newline = match->begin == 0 ? std::string::npos : text.rfind('\n', match->begin - 1);
+        const size_t line_begin = newline == std::string::npos ? 0 : newline + 1;
+        const size_t line_end = std::min(text.find('\n', match->begin), text.size());
+
+        std::cout.write(text.data() + line_begin, line_end - line_begin);
+        std::cout << '\n';
+        from = line_end + 1;
+    }
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         std::cerr << "Usage: " << argv[0] << " <lab_number>\n";
         return 1;
     }
 
+    if (std::string(argv[1]) == "fuzz") {
+        fuzz_cnf(argc >= 3 ? std::strtoull(argv[2], nullptr, 10) : 1000);
+        return 0;
+    }
+
+    if (std::string(argv[1]) == "generate") {
+        if (argc < 3) {
+            std::cerr << "Usage: " << argv[0] << " generate <regex> [count]\n";
+            return 1;
+        }
+        generate_strings(argv[2], argc >= 4 ? std::strtoull(argv[3], nullptr, 10) : 10);
+        return 0;
+    }
+
+    if (std::string(argv[1]) == "search") {
+        if (argc < 4) {
+            std::cerr << "Usage: " << argv[0] << " search <regex> <file>\n";
+            return 1;
+        }
+        search_file(argv[2], argv[3]);
+        return 0;
+    }
+
     int lab = std::atoi(argv[1]);
 
     switch (lab) {
@@ -4,16 +4,16 @@
 
 #include "parser.hpp"
 
-const Token& Parser::peek(size_t offset) const {
-    const size_t index = pos_ + offset;
-    if (index >= tokens_.size()) {
-        return tokens_.back();
+const Token& Parser::peek(size_t offset) {
+    // past the end the lexer keeps giving End
+    while (lookahead_.size() <= offset) {
+        lookahead_.push_back(lexer_.next_token());
     }
 
-    return tokens_[index];
+    return lookahead_[offset];
 }
 
-bool Parser::check(TokenType type, size_t offset) const {
+bool Parser::check(TokenType type, size_t offset) {
     return peek(offset).type == type;
 }
 
@@ -22,22 +22,25 @@ bool Parser::match(TokenType type) {
         return false;
     }
 
-    ++pos_;
+    lookahead_.pop_front();
     return true;
 }
 
-const Token& Parser::consume(TokenType type, const std::string& message) {
+Token Parser::consume(TokenType type, const std::string& message) {
     if (!check(type)) {
         error_here(peek(), message);
     }
 
-    return tokens_[pos_++];
+    const Token token = lookahead_.front();
+    lookahead_.pop_front();
+    return token;
 }
 
 [[noreturn]] void Parser::error_here(const Token& token, const std::string& message) const {
+    const SourcePosition pos = lexer_.position(token);
     throw std::runtime_error(
-        "Parse error at line " + std::to_string(token.line) +
-        ", column " + std::to_string(token.column) + ": " + message
+        "Parse error at line " + std::to_string(pos.line) +
+        ", column " + std::to_string(pos.column) + ": " + message
     );
 }
 
@@ -70,34 +73,34 @@ std::unique_ptr<CallExpr> Parser::call_expression(const std::string& callee) {
 
 std::unique_ptr<Expression> Parser::primary() {
     if (check(TokenType::Identifier) && check(TokenType::LParen, 1)) {
-        const std::string callee = consume(TokenType::Identifier, "expected function name").lexeme.value();
+        const std::string callee = text(consume(TokenType::Identifier, "expected function name"));
         return call_expression(callee);
     }
 
     if (check(TokenType::Identifier)) {
         return std::make_unique<IdentifierExpr>(
-            consume(TokenType::Identifier, "expected identifier").lexeme.value()
+            text(consume(TokenType::Identifier, "expected identifier"))
         );
     }
 
     if (check(TokenType::StringLiteral)) {
         return std::make_unique<LiteralExpr>(
             "StringLiteral",
-            consume(TokenType::StringLiteral, "expected string literal").lexeme.value()
+            text(consume(TokenType::StringLiteral, "expected string literal"))
         );
     }
 
     if (check(TokenType::Float)) {
         return std::make_unique<LiteralExpr>(
             "FloatLiteral",
-            consume(TokenType::Float, "expected float literal").lexeme.value()
+            text(consume(TokenType::Float, "expected float literal"))
         );
     }
 
     if (check(TokenType::Integer)) {
         return std::make_unique<LiteralExpr>(
             "IntegerLiteral",
-            consume(TokenType::Integer, "expected integer literal").lexeme.value()
+            text(consume(TokenType::Integer, "expected integer literal"))
         );
     }
 
@@ -109,9 +112,9 @@ std::unique_ptr<Expression> Parser::expression() {
 }
 
 std::unique_ptr<TypeDeclarationStmt> Parser::type_declaration() {
-    const std::string name = consume(TokenType::Identifier, "expected identifier").lexeme.value();
+    const std::string name = text(consume(TokenType::Identifier, "expected identifier"));
     consume(TokenType::Colon, "expected ':' in type declaration");
-    const std::string type_name = consume(TokenType::Type, "expected known type").lexeme.value();
+    const std::string type_name = text(consume(TokenType::Type, "expected known type"));
 
     auto node = std::make_unique<TypeDeclarationStmt>(name, type_name);
     if (match(TokenType::Equals)) {
@@ -123,7 +126,7 @@ std::unique_ptr<TypeDeclarationStmt> Parser::type_declaration() {
 }
 
 std::unique_ptr<AssignmentStmt> Parser::assignment() {
-    const std::string target = consume(TokenType::Identifier, "expected assignment target").lexeme.value();
+    const std::string target = text(consume(TokenType::Identifier, "expected assignment target"));
     consume(TokenType::Equals, "expected '=' in assignment");
 
     auto node = std::make_unique<AssignmentStmt>(target);